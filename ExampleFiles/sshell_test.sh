@@ -15,11 +15,14 @@ path=$(pwd)
 
 # counters 
 correct=0
-total=12
+total=38
 
 # binaries
 RM="rm -f"	# don't fail if file doesn't exist
 
+# keep the tests out of ~/.sshell_history
+export SSHELL_HISTORY=$path/$TDIR/history_test
+
 # Test correct exiting
 exit_test(){
   #echo -e "exit\n" | ../sshell 1> ../out_test 2> ../err_test
@@ -191,6 +194,663 @@ pipe_test(){
   $RM $ERRFILE
 }
 
+# concurrent pipe test -- more than a pipe buffer must flow through every stage
+big_pipe_test(){
+  echo -e "seq 1 100000 | cat | wc -l\nexit\n" | timeout 10 ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '2q;d' $OUTFILE)
+  corr_str="100000"
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'seq 1 100000 | cat | wc -l' [0][0][0]"
+
+  echo -n "concurrent pipe test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# pipeline EOF test -- yes sees EPIPE once head exits, and a 200 stage chain sees EOF
+pipeline_eof_test(){
+  chain=$(printf ' | cat%.0s' $(seq 200))
+  echo -e "yes | head -n 1\necho hi$chain | wc -c\nexit\n" | timeout 20 ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed -n '2p;4p' $OUTFILE | tr '\n' ' ')
+  corr_str="y 3 "
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'yes | head -n 1' [141][0]"
+
+  echo -n "pipeline EOF test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# here-document test -- <<END body from the next lines, <<< string, bodies past PIPE_BUF
+heredoc_test(){
+  big=$(seq 2000)
+  echo -e "cat <<END | tr a-z A-Z\nfirst line\n  second\nEND\nwc -c <<< four\nwc -l <<X\n$big\nX\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -v '^sshell\$\|^> ' $OUTFILE | tr '\n' ' ')
+  corr_str="FIRST LINE   SECOND 5 2000 "
+  test_str2=$(sed '1d;$d' $ERRFILE | tr '\n' ' ')
+  corr_str2="+ completed 'wc -c <<< four' [0] + completed 'wc -l <<X' [0] "
+
+  echo -n "here-document test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# fan-out test -- several > files on a stage, with and without a pipe after it
+fanout_test(){
+  echo -e "seq 3000 >fa >fb | wc -l\ncat fa fb | wc -l\necho hi >fa >fb\ncat fb\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -v '^sshell\$' $OUTFILE | tr '\n' ' ')
+  corr_str="3000 6000 hi "
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'seq 3000 >fa >fb | wc -l' [0][0]"
+
+  echo -n "fan-out test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM fa fb
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# substitution test -- $(...) inside a word, split into words, nested, as a file name
+subst_test(){
+  echo -e 'echo a$(echo b)c\necho $(seq 3) | wc -w\necho $(echo $(echo deep))\necho x >$(echo sf)\ncat sf\nexit\n' | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -v '^sshell\$' $OUTFILE | tr '\n' ' ')
+  corr_str="abc 3 deep x "
+  test_str2=$(sed '2q;d' $ERRFILE)
+  corr_str2="+ completed 'echo \$(seq 3) | wc -w' [0][0]"
+
+  echo -n "substitution test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM sf
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# variables test -- export, NAME=value for one command, $NAME, unset
+env_test(){
+  echo -e 'export FOO=bar\nFOO=baz printenv FOO\nprintenv FOO\nX=1\necho $X ${X}y\nprintenv X\nunset FOO\nprintenv FOO\nexit\n' | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -v '^sshell\$' $OUTFILE | tr '\n' ' ')
+  corr_str="baz bar 1 1y "
+  test_str2=$(sed -n '2p;6p;8p' $ERRFILE | tr '\n' ' ')
+  corr_str2="+ completed 'FOO=baz printenv FOO' [0] + completed 'printenv X' [1] + completed 'printenv FOO' [1] "
+
+  echo -n "variables test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# source test -- a script run twice from its cache, then again once it was changed
+source_test(){
+  printf 'echo $N\ncat <<E\nhere\nE\n' > src.sh
+  printf 'echo changed $N\n' > src2.sh
+  echo -e 'N=1\nsource src.sh\nN=2\nsource src.sh\ncp src2.sh src.sh\nsource src.sh\nexit\n' | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -v '^sshell\$' $OUTFILE | tr '\n' ' ')
+  corr_str="1 here 2 here changed 2 "
+  test_str2=$(grep -c "^+ completed 'source src.sh' \[0\]$" $ERRFILE)
+  corr_str2="3"
+
+  echo -n "source test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM src.sh src2.sh
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# parser test -- no spaces around | and >, extra spaces between arguments
+parse_test(){
+  echo -e "echo  a   b|tr a-z A-Z>t\ncat<t\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '3q;d' $OUTFILE)
+  corr_str="A B"
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'echo  a   b|tr a-z A-Z>t' [0][0]"
+
+  echo -n "parser test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM t
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# long line test -- hundreds of arguments and 24 stages, past the old 512 byte / 16 token limits
+long_line_test(){
+  args=$(seq -s ' ' 1 400)
+  cats=$(printf '| cat %.0s' $(seq 1 22))
+  echo -e "echo $args $cats | wc -w\nexit\n" | timeout 10 ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '2q;d' $OUTFILE)
+  corr_str="400"
+  test_str2=$(sed '1q;d' $ERRFILE | grep -o '\(\[0\]\)*$')
+  corr_str2=$(printf '[0]%.0s' $(seq 1 24))
+
+  echo -n "long line test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# hash test -- launches are cached by name, 'hash -r' empties the cache
+hash_test(){
+  echo -e "ls > /dev/null\nls > /dev/null\nhash\nhash -r\nhash\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep '/ls$' $OUTFILE | awk '{print $1}')
+  corr_str="2"
+  test_str2=$(grep -c 'hash table empty' $OUTFILE)
+  corr_str2="1"
+
+  echo -n "hash test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# stage path test -- 'PATH=dir cmd' searches dir, not the cached path of cmd
+stage_path_test(){
+  mkdir -p pd
+  printf '#!/bin/sh\necho from-pd\n' > pd/ls
+  chmod +x pd/ls
+  echo -e "ls > /dev/null\nPATH=$PWD/pd ls\nPATH=$PWD/nowhere ls\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -v '^sshell\$' $OUTFILE)
+  corr_str="from-pd"
+  test_str2=$(sed '3,4p;d' $ERRFILE | tr '\n' ' ')
+  corr_str2="execvp: No such file or directory + completed 'PATH=$PWD/nowhere ls' [1] "
+
+  echo -n "stage path test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM -r pd
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# history test -- history outlives the shell, Ctrl-R finds and runs a command
+history_test(){
+  $RM $SSHELL_HISTORY
+  echo -e "echo persist_me\necho other\nexit\n" | ../sshell > /dev/null 2>&1
+  echo -e "\x12persist\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -x 'persist_me' $OUTFILE)
+  corr_str="persist_me"
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'echo persist_me' [0]"
+
+  echo -n "history test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+  $RM $SSHELL_HISTORY
+}
+
+# foreign history test -- a file that isn't sshell's history is warned about, never overwritten
+foreign_history_test(){
+  printf 'ls -la\ncd /tmp\n' > bash_hist
+  echo -e "echo hi\nexit\n" | SSHELL_HISTORY=bash_hist ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(cat bash_hist | tr '\n' ' ')
+  corr_str="ls -la cd /tmp "
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="Warning: bash_hist is not an sshell history file, history won't be saved"
+
+  echo -n "foreign history test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM bash_hist
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# editor test -- keys typed mid-line are inserted at the cursor
+editor_test(){
+  echo -e "ech hi\x1b[D\x1b[D\x1b[Do\nX echo there\x1b[H\x1b[3~\x1b[3~\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '2q;d' $OUTFILE)
+  corr_str="hi"
+  test_str2=$(sed '2q;d' $ERRFILE)
+  corr_str2="+ completed 'echo there' [0]"
+
+  echo -n "editor test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# completion test -- TAB completes command names and file names
+completion_test(){
+  touch complete_me_file
+  echo -e "ech\tcomplete_me_f\t\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '2q;d' $OUTFILE)
+  corr_str="complete_me_file"
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'echo complete_me_file ' [0]"
+
+  echo -n "completion test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM complete_me_file
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# parallel test -- jobs run over the ':::' list, output kept whole per job
+parallel_test(){
+  echo -e "parallel -j 2 echo x{}y ::: a b\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed -n '2,3p' $OUTFILE | sort | tr '\n' ' ')
+  corr_str="xay xby "
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'parallel -j 2 echo x{}y ::: a b' [0] (2 jobs: [0]x2)"
+
+  echo -n "parallel test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# parallel pipe test -- arguments read from the stages piped into it, none at all
+parallel_pipe_test(){
+  echo -e "seq 1 3 | parallel -j 3 echo n{}\ntrue | parallel echo\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep '^n' $OUTFILE | sort | tr '\n' ' ')
+  corr_str="n1 n2 n3 "
+  test_str2=$(sed -n '1,2p' $ERRFILE | tr '\n' ' ')
+  corr_str2="+ completed 'seq 1 3 | parallel -j 3 echo n{}' [0] (3 jobs: [0]x3) + completed 'true | parallel echo' [0] (0 jobs) "
+
+  echo -n "parallel pipe test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# parallel append test -- grouped output reaches a shell run with '>> file', which sendfile() can't write
+parallel_append_test(){
+  echo pre > pa
+  echo -e "parallel -j 1 echo x{} ::: a b\nexit\n" > pa.sh
+  ../sshell pa.sh 1>> pa 2> $ERRFILE
+
+  test_str=$(cat pa | tr '\n' ' ')
+  corr_str="pre xa xb "
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'parallel -j 1 echo x{} ::: a b' [0] (2 jobs: [0]x2)"
+
+  echo -n "parallel append test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM pa pa.sh
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# parallel jobs test -- a -j too big for the slot table is refused
+parallel_jobs_test(){
+  echo -e "parallel -j 3000000000 echo ::: a\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '1q;d' $ERRFILE)
+  corr_str="Error: parallel runs at most 1024 jobs at once"
+  test_str2=$(sed '2q;d' $ERRFILE)
+  corr_str2="+ completed 'parallel -j 3000000000 echo ::: a' [1]"
+
+  echo -n "parallel jobs test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# job control test -- jobs lists a background job, kill %1 ends it, wait reports it
+job_control_test(){
+  echo -e "sleep 5 &\njobs\nkill %1\nwait\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '3q;d' $OUTFILE)
+  corr_str="[1] Running 'sleep 5 &'"
+  test_str2=$(sed '3q;d' $ERRFILE)
+  corr_str2="+ completed 'sleep 5 &' [143]"
+
+  echo -n "job control test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# kill usage test -- a signal with no target, and pids kill(2) takes as groups, are refused
+kill_usage_test(){
+  echo -e "kill -99999\nkill 0\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '1q;d' $ERRFILE)
+  corr_str="Error: usage: kill [-sig | -s sig] %job|pid ..."
+  test_str2=$(sed '3,4p;d' $ERRFILE | tr '\n' ' ')
+  corr_str2="Error: no such process + completed 'kill 0' [1] "
+
+  echo -n "kill usage test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# trace test -- $SSHELL_TRACE gets a Chrome trace-event JSON array of spans
+trace_test(){
+  echo -e "echo hi | cat\nexit\n" | SSHELL_TRACE=trace.json ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(grep -o '"name":"command","args":{"text":"echo hi | cat"}' trace.json)
+  corr_str='"name":"command","args":{"text":"echo hi | cat"}'
+  test_str2=$(tail -n 1 trace.json)
+  corr_str2="]"
+
+  echo -n "trace test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM trace.json
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# time test -- 'time' adds what each stage used to the completed message
+time_test(){
+  echo -e "time echo hi | cat\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '2q;d' $OUTFILE)
+  corr_str="hi"
+  test_str2=$(sed '1q;d' $ERRFILE | grep -cE "^\+ completed 'time echo hi \| cat' \[0\]\[0\] \(real [0-9.]+s user [0-9.]+s sys [0-9.]+s rss [0-9]+K io [0-9]+/[0-9]+ \| real .* io [0-9]+/[0-9]+\)$")
+  corr_str2="1"
+
+  echo -n "time test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
+# builtin test -- echo, test, cat... run in the shell act like the real binaries
+builtin_test(){
+  echo -e "echo -e a\\tb > bt_file\ncat bt_file nosuch\ntest -f bt_file -a ! -d bt_file\n[ 3 -gt 4 ]\ntest 1 -eq x\nfalse\ncat -n bt_file" > bt_script
+  ../sshell bt_script > $OUTFILE 2>&1
+  SSHELL_EXTERNAL=1 ../sshell bt_script > bt_external 2>&1
+
+  test_str=$(diff $OUTFILE bt_external && echo same)
+  corr_str="same"
+  test_str2=$(grep -c "completed" $OUTFILE)
+  corr_str2="7"
+
+  echo -n "builtin test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE bt_external bt_script bt_file
+}
+
+# batch mode test -- script given on the command line, no prompt or echo
+batch_test(){
+  echo -e "echo hello | cat\nsleep 1&\npwd" > script_test
+  ../sshell script_test 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '1q;d' $OUTFILE)
+  corr_str="hello"
+  test_str2=$(sed '2q;d' $OUTFILE)
+  corr_str2="$path/$TDIR"
+  test_str3=$(sed '3q;d' $ERRFILE)
+  corr_str3="+ completed 'sleep 1&' [0]"
+
+  echo -n "batch mode test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ] &&
+     [ "$test_str3" == "$corr_str3" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+    echo "Got '$test_str3' but expected '$corr_str3'"
+  fi
+  echo
+
+  $RM script_test
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
 # background & test
 background_test(){
   echo -e "sleep 1&\nsleep 2\nexit\n" | ../sshell 1> $OUTFILE 2> $ERRFILE
@@ -314,6 +974,31 @@ invalid_background_test(){
 }
 
 
+# background notice test -- a job that ends while the prompt is idle is reported right away
+notice_test(){
+  (echo "sleep 1&"; sleep 2; echo "exit") | timeout 10 ../sshell 1> $OUTFILE 2> $ERRFILE
+
+  test_str=$(sed '3q;d' $OUTFILE)
+  corr_str="sshell$ exit"
+  test_str2=$(sed '1q;d' $ERRFILE)
+  corr_str2="+ completed 'sleep 1&' [0]"
+
+  echo -n "background notice test -- "
+  if [ "$test_str" == "$corr_str" ] &&
+     [ "$test_str2" == "$corr_str2" ]; then
+    let "correct"++
+    echo "PASS"
+  else
+    echo "FAIL"
+    echo "Got '$test_str' but expected '$corr_str'"
+    echo "Got '$test_str2' but expected '$corr_str2'"
+  fi
+  echo
+
+  $RM $OUTFILE
+  $RM $ERRFILE
+}
+
 # function that just runs every test
 run_all_tests(){
   echo -e "\nBeginning tests. If script hangs, interrupt w/ Ctrl-C"
@@ -325,11 +1010,37 @@ run_all_tests(){
   redirect_out_test
   redirect_in_test
   pipe_test
+  big_pipe_test
+  pipeline_eof_test
+  parse_test
+  heredoc_test
+  fanout_test
+  subst_test
+  env_test
+  source_test
+  long_line_test
   invalid_cmd_test
   invalid_in_test
   invalid_out_test
   invalid_background_test
+  batch_test
   background_test
+  notice_test
+  hash_test
+  stage_path_test
+  history_test
+  foreign_history_test
+  editor_test
+  completion_test
+  parallel_test
+  parallel_pipe_test
+  parallel_append_test
+  parallel_jobs_test
+  job_control_test
+  kill_usage_test
+  trace_test
+  time_test
+  builtin_test
 }
 
 main_func(){
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "arena.h"                                      /* Arena structure and prototypes           */
+/* **************************************************** */
+static Arena *spare;                                    /* Last released arena, reused by NewArena  */
+/* **************************************************** */
+/* **************************************************** */
+/* Allocates a block holding at least size bytes        */
+/* **************************************************** */
+static Arena *NewBlock(size_t size)
+{
+    Arena *B = (Arena *) malloc(sizeof(Arena) + size);
+    if (B == NULL) {                                    /* Out of memory                            */
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    B->more = NULL;
+    B->size = size;
+    B->used = 0;
+    return B;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns an empty arena. The block released last is   */
+/* handed back out, so the steady state never mallocs.  */
+/* **************************************************** */
+Arena *NewArena(void)
+{
+    Arena *A = spare;
+    if (A == NULL) return NewBlock(ARENA_CHUNK);        /* Nothing to reuse                         */
+    spare = NULL;
+    A->used = 0;
+    return A;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Carves size bytes out of the arena. When the newest  */
+/* block is full another one is chained on, so earlier  */
+/* allocations never move.                              */
+/* **************************************************** */
+void *ArenaAlloc(Arena *A, size_t size)
+{
+    void *p;
+    Arena *B = A->more ? A->more : A;                   /* Newest block                             */
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (B->used + size > B->size) {                     /* Doesn't fit, chain on a new block        */
+        B = NewBlock(size > ARENA_CHUNK ? size : ARENA_CHUNK);
+        B->more = A->more;
+        A->more = B;
+    }
+    p = B->data + B->used;
+    B->used += size;
+    return p;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Enlarges an allocation to newSize bytes. The last    */
+/* allocation of a block grows in place when there is   */
+/* room, anything else is copied to a new spot and the  */
+/* old bytes are left until the arena is freed.         */
+/* **************************************************** */
+void *ArenaGrow(Arena *A, void *p, size_t oldSize, size_t newSize)
+{
+    Arena *B = A->more ? A->more : A;                   /* Newest block                             */
+    oldSize = (oldSize + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    newSize = (newSize + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (((char *) p + oldSize == B->data + B->used) && (B->used - oldSize + newSize <= B->size)) {
+        B->used += newSize - oldSize;                   /* Last allocation, extend it in place      */
+        return p;
+    }
+    return memcpy(ArenaAlloc(A, newSize), p, oldSize);  /* Move it                                  */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Copy a string into the arena                         */
+/* **************************************************** */
+char *ArenaDup(Arena *A, const char *str)
+{
+    size_t len = strlen(str) + 1;                       /* Include the '\0'                         */
+    return (char *) memcpy(ArenaAlloc(A, len), str, len);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Release everything in the arena in one step. The     */
+/* first block is kept as the spare for NewArena().     */
+/* **************************************************** */
+void FreeArena(Arena *A)
+{
+    Arena *B, *next;
+    for (B = A->more; B != NULL; B = next) {            /* Overflow blocks go back to malloc        */
+        next = B->more;
+        free(B);
+    }
+    A->more = NULL;
+
+    if (spare == NULL) spare = A;                       /* Keep one around for the next command     */
+    else free(A);
+}
+/* **************************************************** */
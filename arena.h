@@ -0,0 +1,30 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/* **************************************************** */
+/*                   Arena Structures                   */
+/* **************************************************** */
+#define ARENA_CHUNK 4096                                /* Bytes in a new block, enough for most lines      */
+#define ARENA_ALIGN sizeof(void *)                      /* Every allocation starts on a pointer boundary    */
+
+typedef struct Arena {                                  /* Bump allocator, one per command line             */
+    struct Arena *more;                                 /* Overflow blocks, newest first                    */
+    size_t size;                                        /* Usable bytes in data[]                           */
+    size_t used;                                        /* Bytes handed out so far                          */
+    char data[];                                        /* Allocations are carved out of here               */
+} Arena;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Arena Functions                    */
+/* **************************************************** */
+Arena *NewArena(void);                                  /* Get an empty arena, reusing a released one       */
+void *ArenaAlloc(Arena *A, size_t size);                /* Carve size bytes out of the arena                */
+void *ArenaGrow(Arena *A, void *p, size_t oldSize, size_t newSize); /* Enlarge an allocation, may move it  */
+char *ArenaDup(Arena *A, const char *str);              /* Copy a string into the arena                     */
+void FreeArena(Arena *A);                               /* Release everything in the arena in one step      */
+/* **************************************************** */
+
+#endif
@@ -0,0 +1,409 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "common.h"                                     /* Keystrokes, parsing, & common functions        */
+#include "history.h"                                    /* History structures, needed by sshell.h         */
+#include "sshell.h"                                     /* RunCommand() and process list                  */
+#include "batch.h"                                      /* Line reader structure and prototypes           */
+#include "trace.h"                                      /* "command" spans of script lines                */
+/* **************************************************** */
+static Script *scripts;                                 /* Cached scripts, newest first                   */
+static int nScripts;                                    /* Number of them                                 */
+static int depth;                                       /* Scripts running inside each other              */
+/* **************************************************** */
+
+/* **************************************************** */
+/* Setup a reader on an already open file descriptor    */
+/* **************************************************** */
+void InitReader(LineReader *R, int fd)
+{
+    R->fd    = fd;                                      /* Where the lines come from                */
+    R->size  = BATCH_CHUNK;                             /* One chunk to start with                  */
+    R->buf   = (char *) malloc(R->size + 1);            /* +1 so the last line can be terminated    */
+    R->start = 0;                                       /* Nothing consumed yet                     */
+    R->end   = 0;                                       /* Nothing read yet                         */
+    R->eof   = 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Release the reader's buffer                          */
+/* **************************************************** */
+void FreeReader(LineReader *R)
+{
+    free(R->buf);
+    R->buf = NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Reads once more into the buffer, making room first   */
+/* by dropping consumed bytes or growing it. Sets eof   */
+/* at the end of the input or on a read() failure.      */
+/* **************************************************** */
+void FillReader(LineReader *R)
+{
+    ssize_t got;
+
+    if (R->start && R->end == R->size) {                /* Out of room, reclaim consumed bytes      */
+        memmove(R->buf, R->buf + R->start, R->end - R->start);
+        R->end -= R->start;
+        R->start = 0;
+    } else if (R->end == R->size) {                     /* A single line fills the buffer, grow it  */
+        R->size *= 2;
+        R->buf = (char *) realloc(R->buf, R->size + 1);
+    }
+
+    got = read(R->fd, R->buf + R->end, R->size - R->end);
+    if (got > 0)
+        R->end += got;                                  /* More bytes to split                      */
+    else if (got == 0 || errno != EINTR)
+        R->eof = 1;                                     /* End of file or read() failure            */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns 1 if ReadLine() can return without reading,  */
+/* a whole line is buffered or the input has ended      */
+/* **************************************************** */
+char LineReady(LineReader *R)
+{
+    return R->eof || (memchr(R->buf + R->start, '\n', R->end - R->start) != NULL);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the next line, '\n' replaced with '\0'.      */
+/* Lines are split with memchr() over whole chunks, so  */
+/* there is one read() per BATCH_CHUNK bytes, not one   */
+/* per character. The line stays valid until the next  */
+/* call. Returns NULL once the input is exhausted.      */
+/* **************************************************** */
+char *ReadLine(LineReader *R, size_t *len)
+{
+    char *line, *nl;
+    size_t scanned = 0;                                 /* Bytes already known to hold no '\n'      */
+
+    while (1) {
+        line = R->buf + R->start;
+        nl = memchr(line + scanned, '\n', R->end - R->start - scanned);
+        if (nl != NULL) {                               /* A complete line is buffered              */
+            *nl = '\0';
+            *len = nl - line;
+            R->start += *len + 1;                       /* Consume the line and its '\n'            */
+            return line;
+        }
+        scanned = R->end - R->start;
+
+        if (R->eof) {                                   /* No more input coming                     */
+            if (R->start == R->end) return NULL;        /* Everything consumed                      */
+            line[scanned] = '\0';                       /* Last line had no '\n'                    */
+            *len = scanned;
+            R->start = R->end;
+            return line;
+        }
+
+        FillReader(R);                                  /* Offsets past start stay valid            */
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Waits until every background job has been reported   */
+/* **************************************************** */
+static void WaitForJobs(void)
+{
+    CheckCompletedProcesses(processList);               /* Report anything already done             */
+    while (processList->count) {                        /* Until the table is empty                 */
+        WaitEvent(FALSE);                               /* Sleep until the next child ends          */
+        CheckCompletedProcesses(processList);
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Here-document lines come from the script's reader    */
+/* **************************************************** */
+static char *ScriptLine(void *ctx, size_t *len)
+{
+    return ReadLine((LineReader *) ctx, len);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Releases a cached script and all it parsed           */
+/* **************************************************** */
+static void FreeScript(Script *S)
+{
+    FreeArena(S->A);
+    free(S->path);
+    free(S);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the cached script for path, if the file st   */
+/* describes is still the one it was parsed from: same  */
+/* device and inode, size and mtime. An entry for path  */
+/* that is out of date is dropped, unless a run of it   */
+/* is still in progress. Returns NULL if there is none. */
+/* **************************************************** */
+static Script *FindScript(const char *path, struct stat *st)
+{
+    Script **link, *S;
+
+    for (link = &scripts; (S = *link) != NULL; link = &S->next) {
+        if (strcmp(S->path, path)) continue;
+        if ((S->dev == st->st_dev) && (S->ino == st->st_ino) && (S->size == st->st_size)
+            && (S->mtime.tv_sec == st->st_mtim.tv_sec) && (S->mtime.tv_nsec == st->st_mtim.tv_nsec))
+            return S;
+        if (!S->busy) {                                 /* Edited, moved or replaced since          */
+            *link = S->next;
+            FreeScript(S);
+            nScripts--;
+        }
+        return NULL;
+    }
+    return NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Caches a script that was run to its end. It replaces */
+/* any entry for the same path, and the oldest entry is */
+/* dropped once there are SCRIPT_CACHE of them. Entries */
+/* in use are never dropped, S is freed instead if it   */
+/* would replace one.                                   */
+/* **************************************************** */
+static void KeepScript(Script *S)
+{
+    Script **link, **oldest = NULL, *old;
+
+    for (link = &scripts; (old = *link) != NULL; link = &old->next) {
+        if (!strcmp(old->path, S->path)) {
+            if (old->busy) {                            /* A nested run still reads it              */
+                FreeScript(S);
+                return;
+            }
+            *link = old->next;
+            FreeScript(old);
+            nScripts--;
+            break;
+        }
+        if (!old->busy) oldest = link;
+    }
+    if ((nScripts == SCRIPT_CACHE) && (oldest != NULL)) {
+        old = *oldest;
+        *oldest = old->next;
+        FreeScript(old);
+        nScripts--;
+    }
+    S->next = scripts;                                  /* Newest first                             */
+    scripts = S;
+    nScripts++;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Parses the next line of a script into its cache      */
+/* entry. The text is copied into the entry's arena     */
+/* first and parsed in place there, so the words, argv  */
+/* arrays and '<<' bodies all end up in it and nothing  */
+/* has to be moved afterwards. '<<' bodies are the      */
+/* script's next lines, as before. A bad line reports   */
+/* its error now, and is kept so a later run reports it */
+/* again. A blank line isn't kept at all.               */
+/* Returns the line, NULL if it was blank               */
+/* **************************************************** */
+static CachedLine *CompileLine(Script *S, const char *line, size_t len, LineReader *R)
+{
+    CachedLine *L;
+    char *text = (char *) memcpy(ArenaAlloc(S->A, len + 1), line, len + 1);
+
+    if (S->nLines == S->lineSlots) {                    /* Out of room, double it                   */
+        S->line = (CachedLine *) ArenaGrow(S->A, S->line, S->lineSlots * sizeof(CachedLine),
+                                           2 * S->lineSlots * sizeof(CachedLine));
+        S->lineSlots *= 2;
+    }
+    L = &S->line[S->nLines];
+    L->text = ArenaDup(S->A, text);                     /* The parser cuts text up                  */
+    L->parsed = !ParseLine(text, &L->C, S->A, ScriptLine, R);
+    if (L->parsed && !L->C.nStages) return NULL;        /* Nothing to run, now or later             */
+    S->nLines++;
+    return L;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns a copy of n pointers in A                    */
+/* **************************************************** */
+static char **CopyWords(Arena *A, char **words, int n)
+{
+    return (char **) memcpy(ArenaAlloc(A, n * sizeof(char *)), words, n * sizeof(char *));
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a cached line. Filling in $(...)s and the       */
+/* builtins change the stages and their arrays, so they */
+/* are copied into a new arena for the run: a few       */
+/* pointers per word, the words themselves stay in the  */
+/* cache. A bad line is parsed again from a copy, which */
+/* reports the same error without reading any more of   */
+/* the script.                                          */
+/* Returns 1 if 'exit' was run, 0 otherwise             */
+/* **************************************************** */
+static char RunCached(CachedLine *L)
+{
+    Arena *A = NewArena();
+    Command C = L->C;
+    Stage *S;
+    int N;
+
+    if (!L->parsed) {                                   /* Fails again, same message                */
+        ParseLine(ArenaDup(A, L->text), &C, A, NULL, NULL);
+        FreeArena(A);
+        return 0;
+    }
+    C.stage = (Stage *) memcpy(ArenaAlloc(A, C.nStages * sizeof(Stage)), L->C.stage, C.nStages * sizeof(Stage));
+    C.stageSlots = C.nStages;
+    for (N = 0; N < C.nStages; N++) {
+        S = &C.stage[N];
+        S->argSlots = S->argc + 1;                      /* Room for its NULL                        */
+        S->argv = CopyWords(A, S->argv, S->argSlots);
+        if (S->nTee) S->teeFile = CopyWords(A, S->teeFile, S->teeSlots = S->nTee);
+        if (S->nAssign) S->assign = CopyWords(A, S->assign, S->assignSlots = S->nAssign);
+    }
+    return RunParsed(&C, A, ArenaDup(A, L->text));
+}
+/* **************************************************** */
+/* **************************************************** */
+/* After each line of a script: an 'exit' that was run  */
+/* ends a nested script at once, but the top one only   */
+/* once no jobs are left running. Finished background   */
+/* jobs are reported.                                   */
+/* Returns 1 if the script stops here, 0 otherwise      */
+/* **************************************************** */
+static char LineDone(char quit, char top)
+{
+    if (quit && top) {                                  /* 'exit' was read                          */
+        CheckCompletedProcesses(processList);           /* Finished jobs don't block the exit       */
+        if (processList->count) {
+            ThrowError("Error: active jobs still running");
+            CompleteCmd("exit", 1);                     /* Same as typing 'exit' with jobs running  */
+            quit = 0;
+        }
+    }
+    CheckCompletedProcesses(processList);               /* Report finished background jobs          */
+    return quit;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a script one line at a time. No prompt, echo,   */
+/* or history. The first run reads the file with a      */
+/* LineReader and parses each line just before it runs, */
+/* keeping what it parsed. Once it reaches the end, the */
+/* script is cached by path, and a later run of the     */
+/* unchanged file replays the parsed lines: the file    */
+/* isn't read, and no line or '<<' body is parsed again.*/
+/* top is 1 for 'sshell script', whose 'exit' waits for */
+/* running jobs, and 0 for 'source'.                    */
+/* Returns EXIT_SUCCESS, or EXIT_FAILURE if the script  */
+/* can't be opened. *quit is set if 'exit' was run.     */
+/* **************************************************** */
+static int RunScript(const char *script, char top, char *quit)
+{
+    LineReader R;
+    struct stat st;
+    Script *S;
+    CachedLine *L;
+    char *line;
+    size_t len;
+    int fd, i;
+
+    *quit = 0;
+    if (depth == SCRIPT_DEPTH) {                        /* A script that sources itself             */
+        ThrowError("Error: scripts nested too deeply");
+        return EXIT_FAILURE;
+    }
+    if ((fd = OpenMe(script, RMODE)) == -1) return EXIT_FAILURE; /* OpenMe() reported the error */
+    fstat(fd, &st);
+    depth++;
+
+    if ((S = FindScript(script, &st)) != NULL) {        /* Parsed by an earlier run                 */
+        close(fd);
+        S->busy++;
+        for (i = 0; !*quit && (i < S->nLines); i++) {
+            TRACE_BEGIN("command", S->line[i].text);
+            *quit = RunCached(&S->line[i]);
+            TRACE_END(0);
+            *quit = LineDone(*quit, top);
+        }
+        S->busy--;
+        depth--;
+        return EXIT_SUCCESS;
+    }
+
+    S = (Script *) malloc(sizeof(Script));              /* First run, or the file changed           */
+    S->path = strdup(script);
+    S->dev = st.st_dev;
+    S->ino = st.st_ino;
+    S->size = st.st_size;
+    S->mtime = st.st_mtim;
+    S->A = NewArena();
+    S->lineSlots = SCRIPT_LINES;
+    S->line = (CachedLine *) ArenaAlloc(S->A, S->lineSlots * sizeof(CachedLine));
+    S->nLines = 0;
+    S->busy = 1;
+    S->next = NULL;
+
+    InitReader(&R, fd);
+    while (!*quit && ((line = ReadLine(&R, &len)) != NULL)) {
+        if (len >= ArgMax()) {                          /* Same limit the keyboard input has        */
+            ThrowError("Error: command line too long");
+            S->busy = -1;                               /* Reported here only, don't cache it       */
+            continue;
+        }
+        TRACE_BEGIN("command", line);
+        L = CompileLine(S, line, len, &R);
+        if ((L != NULL) && L->parsed) *quit = RunCached(L);
+        TRACE_END(0);
+        *quit = LineDone(*quit, top);
+    }
+    FreeReader(&R);
+    close(fd);
+    depth--;
+    if (*quit || (S->busy == -1)) FreeScript(S);        /* Stopped early, the rest wasn't parsed    */
+    else {
+        S->busy = 0;
+        KeepScript(S);
+    }
+    return EXIT_SUCCESS;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a script in the running shell, as 'source' does */
+/* so its variables and 'cd' stay. Returns its status,  */
+/* *quit is set if it ran 'exit'.                       */
+/* **************************************************** */
+int SourceScript(const char *script, char *quit)
+{
+    *quit = 0;
+    if (script == NULL) {
+        ThrowError("Error: no script given");
+        return EXIT_FAILURE;
+    }
+    return RunScript(script, FALSE, quit);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs 'sshell script'. Background jobs still running  */
+/* at the end of the script are waited for before       */
+/* returning.                                           */
+/* **************************************************** */
+int RunBatch(const char *script)
+{
+    char quit;
+    int status = RunScript(script, TRUE, &quit);
+
+    WaitForJobs();                                      /* Let background jobs finish               */
+    FlushOut();                                         /* Last '+ completed' messages              */
+    return status;
+}
+/* **************************************************** */
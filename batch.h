@@ -0,0 +1,58 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <sys/stat.h>                                   /* Identity of a cached script's file               */
+#include "parse.h"                                      /* Cached scripts hold parsed lines                 */
+
+/* **************************************************** */
+/*                   Batch Structures                   */
+/* **************************************************** */
+#define BATCH_CHUNK 65536                               /* Bytes pulled in by each read() call              */
+
+typedef struct LineReader {                             /* Buffered line splitter for non-interactive input */
+    int fd;                                             /* File descriptor lines are read from              */
+    char *buf;                                          /* Holds the bytes read but not yet consumed        */
+    size_t size;                                        /* Capacity of buf, grows for very long lines       */
+    size_t start;                                       /* Offset of the next unconsumed byte               */
+    size_t end;                                         /* Offset one past the last byte read               */
+    char eof;                                           /* 1 once read() has returned 0 or failed           */
+} LineReader;
+
+#define SCRIPT_LINES 64                                 /* First room for a cached script's lines           */
+#define SCRIPT_CACHE 16                                 /* Scripts kept parsed at once                      */
+#define SCRIPT_DEPTH 64                                 /* 'source' calls nested in each other              */
+
+typedef struct CachedLine {                             /* One line of a cached script                      */
+    char *text;                                         /* The line as written, for '+ completed'           */
+    Command C;                                          /* Parsed, $(...) and $NAME not yet filled in       */
+    char parsed;                                        /* 0 if it is bad, it is parsed again to report it  */
+} CachedLine;
+
+typedef struct Script {                                 /* A script parsed by its first run                 */
+    char *path;                                         /* As it was given to 'source'                      */
+    dev_t dev;                                          /* The file it was read from                        */
+    ino_t ino;
+    off_t size;                                         /* Size and mtime it had then, a change in either   */
+    struct timespec mtime;                              /* means it is parsed again                         */
+    Arena *A;                                           /* Holds the lines and all that is parsed from them */
+    CachedLine *line;                                   /* Lines in order, blank ones left out              */
+    int nLines;                                         /* Number of lines                                  */
+    int lineSlots;                                      /* Room in line, doubled when it fills up           */
+    int busy;                                           /* Runs in progress, it isn't freed while nonzero   */
+    struct Script *next;                                /* Older cached script                              */
+} Script;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                    Batch Functions                   */
+/* **************************************************** */
+void InitReader(LineReader *R, int fd);                 /* Setup a reader on an open file descriptor        */
+void FreeReader(LineReader *R);                         /* Release the reader's buffer                      */
+char *ReadLine(LineReader *R, size_t *len);             /* Next NUL terminated line, NULL at end of input   */
+void FillReader(LineReader *R);                         /* One more read() into the buffer, sets eof at end */
+char LineReady(LineReader *R);                          /* 1 if ReadLine() won't read, a line is buffered   */
+int SourceScript(const char *script, char *quit);       /* Runs a script in this shell, parsed at most once */
+int RunBatch(const char *script);                       /* Runs every line of a script, no prompt/history   */
+/* **************************************************** */
+
+#endif
@@ -0,0 +1,431 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "common.h"                                     /* Keystrokes, parsing, & common functions        */
+#include "history.h"                                    /* History structures, needed by sshell.h         */
+#include "sshell.h"                                     /* ForkMe() and SpawnMe() launch backends         */
+#include "parse.h"                                      /* ParseCommand() single pass parser              */
+#include "process.h"                                    /* Job table under test                           */
+#include "env.h"                                        /* Variable table and the cached envp             */
+/* **************************************************** */
+
+/* **************************************************** */
+/*                  Bench Settings                      */
+/* **************************************************** */
+#define BENCH_LAUNCHES 2000                             /* Commands launched per measurement              */
+#define MiB           (1024*1024)
+static const int ballastMiB[] = {0, 64, 256};           /* Extra resident memory the shell carries        */
+#define BENCH_PARSES  200000                            /* Lines parsed per measurement                   */
+static const int parseShape[][2] = {                    /* Stages and arguments per stage in each line    */
+    {1, 8}, {4, 16}, {24, 16}, {16, 500}
+};
+#define N_BALLAST     (int)(sizeof(ballastMiB) / sizeof(*ballastMiB))
+#define N_SHAPES      (int)(sizeof(parseShape) / sizeof(*parseShape))
+#define BENCH_JOBS    200000                            /* Jobs pushed through the table per measurement  */
+static const int jobCount[] = {10, 100, 1000};          /* Jobs in the table at the same time             */
+#define N_JOBCOUNTS   (int)(sizeof(jobCount) / sizeof(*jobCount))
+#define FAKE_PID      4000000                           /* Above pid_max, never a real child              */
+#define PIPE_MiB      256                               /* Bytes pushed through the pipeline              */
+#define PIPE_CMD      "cat <%s | cat | wc -c >/dev/null"
+#define HIST_FILLED   100000                            /* Commands in the searched history               */
+#define BENCH_SEARCH  20000                             /* Ctrl-R lookups per measurement                 */
+#define ENV_VARS      200                               /* Variables exported on top of the real ones     */
+#define BENCH_ENV     200000                            /* Environment() calls per measurement            */
+/* **************************************************** */
+
+/* **************************************************** */
+/*                  Bench Results                       */
+/* **************************************************** */
+typedef struct LaunchResult {                           /* One row of the launch table                    */
+    int ballast;                                        /* MiB of ballast, -1 if it couldn't be allocated */
+    double fork, spawn;                                 /* Commands per second                            */
+} LaunchResult;
+
+typedef struct ParseResult {                            /* One row of the parse table                     */
+    int len;                                            /* Bytes in the generated line                    */
+    double rate;                                        /* Lines per second                               */
+} ParseResult;
+
+typedef struct JobResult {                              /* One row of the job table                       */
+    double add, mark, reap;                             /* Nanoseconds per job for each step              */
+} JobResult;
+
+typedef struct EnvResult {                              /* The environment row                            */
+    int vars;                                           /* Exported variables                             */
+    double cached, rebuild, stage;                      /* Nanoseconds per envp handed to a launch        */
+} EnvResult;
+/* **************************************************** */
+
+/* **************************************************** */
+/* Monotonic clock in seconds                           */
+/* **************************************************** */
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Launch 'true' N times through one backend.           */
+/* Returns the number of commands per second.           */
+/* **************************************************** */
+static double LaunchRate(char useFork, int N)
+{
+    char *args[] = {"true", NULL};                      /* Cheapest program to start                      */
+    Process Me;                                         /* Reused for every launch                        */
+    int i, status;
+    double start;
+
+    memset(&Me, 0, sizeof(Me));
+    start = Now();
+    for (i = 0; i < N; i++) {
+        Me.fd[0] = SI;                                  /* No redirects                                   */
+        Me.fd[1] = SO;
+        if (useFork)
+            ForkMe(args, &Me);                          /* fork() + execvp()                              */
+        else if (SpawnMe(args, &Me)) {                  /* posix_spawn(), cached PATH lookup              */
+            perror("posix_spawn");
+            exit(EXIT_FAILURE);
+        }
+        waitpid(Me.PID, &status, 0);                    /* No SIGCHLD handler in the bench driver         */
+    }
+    return N / (Now() - start);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Builds a line of nStages stages, each with nArgs     */
+/* arguments, and both redirects, e.g.                  */
+/* "cmd0 arg1 ... arg7 <in0 | cmd1 ... >out &"          */
+/* Returns the line, which the caller frees.            */
+/* **************************************************** */
+static char *MakeLine(int nStages, int nArgs, int *len)
+{
+    char *line = malloc(nStages * (nArgs + 1) * 12 + 32);
+    int N, i;
+    *len = 0;
+    for (N = 0; N < nStages; N++) {
+        *len += sprintf(line + *len, "%scmd%d", N ? " | " : "", N);
+        for (i = 1; i < nArgs; i++)                     /* Fill the stage's argv                          */
+            *len += sprintf(line + *len, " arg%d", i);
+        if (N == 0) *len += sprintf(line + *len, " <in%d", N);
+    }
+    *len += sprintf(line + *len, " >out &");
+    return line;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Parses a generated line N times. The line is copied  */
+/* first each time since ParseCommand() splits it in    */
+/* place, the same way RunCommand() copies it.          */
+/* Returns the number of lines per second.              */
+/* **************************************************** */
+static double ParseRate(const char *line, int len, int N)
+{
+    char *buf = malloc(len + 1);
+    Command C;
+    Arena *A;
+    int i;
+    double start = Now();
+
+    for (i = 0; i < N; i++) {
+        memcpy(buf, line, len + 1);
+        A = NewArena();
+        if (ParseCommand(buf, &C, A)) exit(EXIT_FAILURE);
+        FreeArena(A);
+    }
+    free(buf);
+    return N / (Now() - start);
+}
+/* **************************************************** */
+/* Pushes N jobs through a table holding n at a time.   */
+/* Each round adds n jobs with AddJob() and            */
+/* AddProcess(), marks them done newest first with      */
+/* MarkProcessDone(), then reaps them all with          */
+/* CheckCompletedProcesses(). The PIDs are fake, no     */
+/* process is started. Fills R with ns per job.         */
+/* **************************************************** */
+static void JobCost(int n, int N, JobResult *R)
+{
+    static Job *jobs[1024];                             /* Jobs of the current round                      */
+    int fd[2] = {SI, SO};
+    int rounds = N / n, r, i;
+    double t0, t1, t2, t3;
+    Arena *A;
+
+    R->add = R->mark = R->reap = 0;
+    for (r = 0; r < rounds; r++) {
+        t0 = Now();
+        for (i = 0; i < n; i++) {
+            A = NewArena();
+            jobs[i] = AddJob(processList, A, ArenaDup(A, "true"), 1, 0, FALSE, fd);
+            jobs[i]->printMe = 0;                       /* Measure the table, not the terminal            */
+            AddProcess(processList, &jobs[i]->stage[0], FAKE_PID + i);
+        }
+        t1 = Now();
+        for (i = n - 1; i >= 0; i--)                    /* Worst case for a list walked from the top      */
+            MarkProcessDone(processList, FAKE_PID + i, 0, NULL);
+        t2 = Now();
+        CheckCompletedProcesses(processList);
+        t3 = Now();
+        R->add  += t1 - t0;
+        R->mark += t2 - t1;
+        R->reap += t3 - t2;
+    }
+    R->add  *= 1e9 / (rounds * n);
+    R->mark *= 1e9 / (rounds * n);
+    R->reap *= 1e9 / (rounds * n);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs PIPE_CMD on a file of PIPE_MiB, going through   */
+/* the same ParseCommand(), AddJob() and ExecProgram()  */
+/* path as RunCommand(), minus the completed message.   */
+/* Returns the bytes per second through the pipeline.   */
+/* **************************************************** */
+static double PipeRate(void)
+{
+    char path[] = "/tmp/sshell_benchXXXXXX";
+    char line[sizeof(PIPE_CMD) + sizeof(path)];
+    char *chunk = malloc(MiB);
+    int fd[2] = {SI, SO};
+    int tmp = mkstemp(path), i;
+    double start;
+    Command C;
+    Arena *A;
+    Job *J;
+
+    if (tmp == -1 || chunk == NULL) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    memset(chunk, 'x', MiB);
+    for (i = 0; i < PIPE_MiB; i++)
+        if (write(tmp, chunk, MiB) != MiB) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+    close(tmp);
+    free(chunk);
+    sprintf(line, PIPE_CMD, path);
+
+    start = Now();
+    A = NewArena();
+    if (ParseCommand(line, &C, A)) exit(EXIT_FAILURE);
+    J = AddJob(processList, A, "bench", C.nStages, C.nFanOut, FALSE, fd);
+    J->printMe = 0;
+    if (ExecProgram(&C, J)) exit(EXIT_FAILURE);         /* Waits for the whole chain                      */
+    start = Now() - start;
+
+    unlink(path);
+    return (double)PIPE_MiB * MiB / start;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Fills a heap history with HIST_FILLED commands, then */
+/* looks up N queries that each match one command.      */
+/* Returns the microseconds per lookup, with the time   */
+/* the first lookup took to build the index in *build.  */
+/* **************************************************** */
+static double SearchCost(int N, double *build)
+{
+    History H;
+    char line[64];
+    uint64_t seq;
+    double start;
+    int i, len;
+
+    setenv("SSHELL_HISTORY", "", 1);                    /* Keep it off the disk                           */
+    OpenHistory(&H);
+    for (i = 0; i < HIST_FILLED; i++) {
+        len = sprintf(line, "make -C src/module%d target%d", i, i * 7);
+        AddHistory(&H, line, len);
+    }
+
+    start = Now();
+    seq = H.file->head;
+    SearchHistory(&H, "zzz", 3, &seq);                  /* Builds the whole index                         */
+    *build = (Now() - start) * 1e3;
+
+    start = Now();
+    for (i = 0; i < N; i++) {
+        len = sprintf(line, "target%d", (i * 7919 % HIST_FILLED) * 7);
+        seq = H.file->head;
+        if (!SearchHistory(&H, line, len, &seq)) exit(EXIT_FAILURE);
+    }
+    start = (Now() - start) * 1e6 / N;
+    CloseHistory(&H);
+    return start;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Exports ENV_VARS variables on top of the real ones,  */
+/* then times the envp each launch gets: the cached one */
+/* from Environment(), one rebuilt after a variable is  */
+/* exported again with a new value, and StageEnv() for  */
+/* a "NAME=value cmd" stage, arena included.            */
+/* **************************************************** */
+static void EnvCost(int N, EnvResult *R)
+{
+    extern char **environ;
+    char *argv[3] = {"export", NULL, NULL};
+    char *assign[1] = {"BENCH_VAR0=stage"};
+    char pair[64], **e;
+    Arena *A;
+    double start;
+    int i;
+
+    InitVars(environ);
+    for (i = 0; i < ENV_VARS; i++) {
+        sprintf(pair, "BENCH_VAR%d=value%d", i, i);
+        argv[1] = pair;
+        ExportVars(argv);
+    }
+    for (R->vars = 0, e = Environment(); *e != NULL; e++) R->vars++;
+
+    start = Now();
+    for (i = 0; i < N; i++)
+        if (Environment() == NULL) exit(EXIT_FAILURE);
+    R->cached = (Now() - start) * 1e9 / N;
+
+    start = Now();
+    for (i = 0; i < N / 100; i++) {                     /* Each one rebuilds the whole envp               */
+        sprintf(pair, "BENCH_VAR0=%d", i);
+        argv[1] = pair;
+        ExportVars(argv);
+    }
+    R->rebuild = (Now() - start) * 1e9 / (N / 100);
+
+    start = Now();
+    for (i = 0; i < N / 100; i++) {
+        A = NewArena();
+        StageEnv(assign, 1, A);
+        FreeArena(A);
+    }
+    R->stage = (Now() - start) * 1e9 / (N / 100);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Writes every result to a JSON file, so runs of       */
+/* different releases can be diffed by a script.        */
+/* **************************************************** */
+static void WriteJSON(const char *file, int N, LaunchResult *L, ParseResult *P, JobResult *J, double pipeRate,
+                      double indexMs, double searchUs, EnvResult *E)
+{
+    FILE *out = fopen(file, "w");
+    int i;
+
+    if (out == NULL) {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(out, "{\n  \"launches\": %d,\n  \"launch\": [", N);
+    for (i = 0; i < N_BALLAST && L[i].ballast >= 0; i++)
+        fprintf(out, "%s\n    {\"ballast_mib\": %d, \"fork_cmds_per_s\": %.0f, \"spawn_cmds_per_s\": %.0f, "
+                "\"fork_latency_us\": %.2f, \"spawn_latency_us\": %.2f}", i ? "," : "",
+                L[i].ballast, L[i].fork, L[i].spawn, 1e6 / L[i].fork, 1e6 / L[i].spawn);
+    fprintf(out, "\n  ],\n  \"parse\": [");
+    for (i = 0; i < N_SHAPES; i++)
+        fprintf(out, "%s\n    {\"stages\": %d, \"args\": %d, \"line_bytes\": %d, \"lines_per_s\": %.0f, "
+                "\"bytes_per_s\": %.0f}", i ? "," : "",
+                parseShape[i][0], parseShape[i][1], P[i].len, P[i].rate, P[i].rate * P[i].len);
+    fprintf(out, "\n  ],\n  \"jobs\": [");
+    for (i = 0; i < N_JOBCOUNTS; i++)
+        fprintf(out, "%s\n    {\"jobs\": %d, \"add_ns\": %.1f, \"mark_done_ns\": %.1f, \"reap_ns\": %.1f}",
+                i ? "," : "", jobCount[i], J[i].add, J[i].mark, J[i].reap);
+    fprintf(out, "\n  ],\n  \"pipeline\": {\"command\": \"cat | cat | wc -c\", \"bytes\": %lld, "
+            "\"bytes_per_s\": %.0f},\n  \"history\": {\"entries\": %d, \"index_build_ms\": %.1f, "
+            "\"search_us\": %.2f},\n  \"env\": {\"vars\": %d, \"cached_ns\": %.1f, \"rebuild_ns\": %.1f, "
+            "\"stage_ns\": %.1f}\n}\n", (long long)PIPE_MiB * MiB, pipeRate, HIST_FILLED, indexMs, searchUs,
+            E->vars, E->cached, E->rebuild, E->stage);
+    fclose(out);
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/*                        MAIN                          */
+/* **************************************************** */
+int main(int argc, char *argv[])
+{
+    int i, opt, N = BENCH_LAUNCHES;
+    char *json = NULL;                                  /* -j FILE, where the JSON results go             */
+    char *ballast = NULL;                               /* Grows the page tables fork() has to copy       */
+    char *line;                                         /* Generated command line                         */
+    LaunchResult launch[N_BALLAST];
+    ParseResult parse[N_SHAPES];
+    JobResult jobs[N_JOBCOUNTS];
+    EnvResult env;
+    double pipeRate, indexMs, searchUs;
+
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        if (opt != 'j') {
+            fprintf(stderr, "usage: %s [-j results.json] [launches]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        json = optarg;
+    }
+    if (optind < argc) N = atoi(argv[optind]);
+
+    printf("%-8s %12s %14s %14s %8s\n", "launch", "ballast", "fork cmds/s", "spawn cmds/s", "speedup");
+    for (i = 0; i < N_BALLAST; i++) {
+        free(ballast);
+        ballast = NULL;
+        launch[i].ballast = -1;
+        if (ballastMiB[i]) {
+            ballast = malloc((size_t)ballastMiB[i] * MiB);
+            if (ballast == NULL) break;                 /* Not enough memory for this row                 */
+            memset(ballast, 1, (size_t)ballastMiB[i] * MiB);
+        }
+        launch[i].ballast = ballastMiB[i];
+        launch[i].fork  = LaunchRate(TRUE, N);
+        launch[i].spawn = LaunchRate(FALSE, N);
+        printf("%-8s %9d MiB %14.0f %14.0f %7.2fx\n", "true", ballastMiB[i], launch[i].fork, launch[i].spawn,
+               launch[i].spawn / launch[i].fork);
+    }
+    free(ballast);
+
+    printf("\n%-8s %8s %12s %14s %14s\n", "stages", "args", "line bytes", "lines/s", "MiB/s");
+    for (i = 0; i < N_SHAPES; i++) {
+        line = MakeLine(parseShape[i][0], parseShape[i][1], &parse[i].len);
+        parse[i].rate = ParseRate(line, parse[i].len, N * (BENCH_PARSES / BENCH_LAUNCHES) / parseShape[i][0]);
+        printf("%-8d %8d %12d %14.0f %14.1f\n", parseShape[i][0], parseShape[i][1], parse[i].len,
+               parse[i].rate, parse[i].rate * parse[i].len / MiB);
+        free(line);
+    }
+
+    processList = malloc(sizeof(ProcessList));          /* Same setup as the shell's main()               */
+    InitProcesses();
+
+    printf("\n%-8s %12s %12s %12s\n", "jobs", "add ns", "done ns", "reap ns");
+    for (i = 0; i < N_JOBCOUNTS; i++) {
+        JobCost(jobCount[i], N * (BENCH_JOBS / BENCH_LAUNCHES), &jobs[i]);
+        printf("%-8d %12.1f %12.1f %12.1f\n", jobCount[i], jobs[i].add, jobs[i].mark, jobs[i].reap);
+    }
+
+    pipeRate = PipeRate();
+    printf("\n%-20s %8s %14s\n", "pipeline", "MiB", "MiB/s");
+    printf("%-20s %8d %14.1f\n", "cat | cat | wc -c", PIPE_MiB, pipeRate / MiB);
+
+    searchUs = SearchCost(N * (BENCH_SEARCH / BENCH_LAUNCHES), &indexMs);
+    printf("\n%-20s %8s %14s %14s\n", "history", "entries", "index ms", "search us");
+    printf("%-20s %8d %14.1f %14.2f\n", "Ctrl-R", HIST_FILLED, indexMs, searchUs);
+
+    EnvCost(N * (BENCH_ENV / BENCH_LAUNCHES), &env);
+    printf("\n%-20s %8s %14s %14s %14s\n", "environment", "vars", "cached ns", "rebuild ns", "stage ns");
+    printf("%-20s %8d %14.1f %14.1f %14.1f\n", "envp", env.vars, env.cached, env.rebuild, env.stage);
+
+    if (json != NULL) WriteJSON(json, N, launch, parse, jobs, pipeRate, indexMs, searchUs, &env);
+    return EXIT_SUCCESS;
+}
+/* **************************************************** */
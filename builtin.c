@@ -0,0 +1,533 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "common.h"                                     /* CompleteCmd() and fd names               */
+#include "history.h"                                    /* History structures, needed by sshell.h   */
+#include "sshell.h"                                     /* Redirect()                               */
+#include "builtin.h"                                    /* Builtin table and prototypes             */
+/* **************************************************** */
+
+/* **************************************************** */
+/* Writes all of buf, retrying short writes.            */
+/* Returns 0, or 1 if the write failed.                 */
+/* **************************************************** */
+static int WriteAll(int fd, const char *buf, size_t len)
+{
+    ssize_t put;
+    while (len) {
+        if ((put = write(fd, buf, len)) == -1) {
+            if (errno == EINTR) continue;
+            return 1;                                   /* EPIPE, ENOSPC, ...                       */
+        }
+        buf += put;
+        len -= put;
+    }
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Prints "name: what: reason" to STDERR, the way the   */
+/* coreutils versions report errors                     */
+/* **************************************************** */
+static void BuiltinError(const char *name, const char *what)
+{
+    char msg[PATH_MAX + 64];
+    snprintf(msg, sizeof(msg), "%s: %s: %s", name, what, strerror(errno));
+    ThrowError(msg);
+    FlushOut();                                         /* Output that follows is written directly  */
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/*                  true & false                        */
+/* **************************************************** */
+static int TrueMe(int argc, char *argv[], int *fd)
+{
+    return 0;
+}
+static int FalseMe(int argc, char *argv[], int *fd)
+{
+    return 1;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Expands the backslash escapes echo -e knows into out */
+/* Returns the bytes written, and sets *stop on '\c'.   */
+/* **************************************************** */
+static size_t Unescape(const char *in, char *out, char *stop)
+{
+    char *o = out;
+    int i, v;
+
+    while (*in) {
+        if (*in != '\\' || !in[1]) {
+            *o++ = *in++;
+            continue;
+        }
+        switch (*++in) {
+            case 'a': *o++ = '\a'; break;
+            case 'b': *o++ = '\b'; break;
+            case 'e': *o++ = 0x1B; break;
+            case 'f': *o++ = '\f'; break;
+            case 'n': *o++ = '\n'; break;
+            case 'r': *o++ = '\r'; break;
+            case 't': *o++ = '\t'; break;
+            case 'v': *o++ = '\v'; break;
+            case '\\': *o++ = '\\'; break;
+            case 'c': *stop = 1; return o - out;        /* Nothing more is printed                  */
+            case '0':                                   /* \0NNN, octal                             */
+                for (i = 0, v = 0; i < 3 && in[1] >= '0' && in[1] <= '7'; i++)
+                    v = v * 8 + (*++in - '0');
+                *o++ = v;
+                break;
+            case 'x':                                   /* \xHH, hex                                */
+                if (!isxdigit((unsigned char) in[1])) {
+                    *o++ = '\\';
+                    *o++ = 'x';
+                    break;
+                }
+                for (i = 0, v = 0; i < 2 && isxdigit((unsigned char) in[1]); i++) {
+                    in++;
+                    v = v * 16 + (isdigit((unsigned char) *in) ? *in - '0' : (*in | 0x20) - 'a' + 10);
+                }
+                *o++ = v;
+                break;
+            default:                                    /* Not an escape, keep the backslash        */
+                *o++ = '\\';
+                *o++ = *in;
+        }
+        in++;
+    }
+    return o - out;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* echo [-neE] [string ...] - Options are only taken    */
+/* while every letter of the word is one of n, e or E,  */
+/* like coreutils. Output is a single write().          */
+/* **************************************************** */
+static int EchoMe(int argc, char *argv[], int *fd)
+{
+    char newline = 1, escapes = 0, stop = 0, *out, *p;
+    size_t size = 1, len = 0;
+    int i = 1, j, status;
+
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) break;
+        for (p = argv[i] + 1; *p; p++) {
+            if (*p == 'n') newline = 0;
+            else escapes = (*p == 'e');
+        }
+    }
+
+    for (j = i; j < argc; j++) size += strlen(argv[j]) + 1;
+    out = (char *) malloc(size);                        /* Escapes only ever shrink the text        */
+    for (; i < argc && !stop; i++) {
+        if (escapes) len += Unescape(argv[i], out + len, &stop);
+        else {
+            strcpy(out + len, argv[i]);
+            len += strlen(argv[i]);
+        }
+        if (!stop && i + 1 < argc) out[len++] = ' ';
+    }
+    if (newline && !stop) out[len++] = '\n';
+
+    status = WriteAll(fd[1], out, len);
+    free(out);
+    return status;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Returns 1 if every file cat is to read is a regular  */
+/* file, which always reaches its end. A terminal, pipe,*/
+/* FIFO or device can block or never end, and the shell */
+/* can't be stopped by CTRL+C while it copies, so those */
+/* are left to the real cat. A file that can't be found */
+/* is reported by CatMe() as cat would.                 */
+/* **************************************************** */
+static int CatFinite(int argc, char *argv[], int in)
+{
+    struct stat st;
+    int i;
+
+    for (i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "-")) {
+            if ((fstat(in, &st) == -1) || !S_ISREG(st.st_mode)) return 0;
+        } else if ((stat(argv[i], &st) == 0) && !S_ISREG(st.st_mode)) return 0;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* cat [file ...] - Files named '-' are the stage's     */
+/* input. Options, the shell's own STDIN, and anything  */
+/* but regular files are left to the real cat.          */
+/* **************************************************** */
+static int CatMe(int argc, char *argv[], int *fd)
+{
+    static char buf[BUILTIN_CHUNK];                     /* Reused, the shell runs one builtin a time */
+    char *stdinName[] = {"cat", "-", NULL};
+    int i, in, status = 0;
+    ssize_t got;
+
+    for (i = 1; i < argc; i++)
+        if (argv[i][0] == '-' && argv[i][1]) return BUILTIN_EXTERNAL;
+    if (argc == 1) {                                    /* No files, copy the input                 */
+        argv = stdinName;
+        argc = 2;
+    }
+    for (i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "-") && (fd[0] == SI)) return BUILTIN_EXTERNAL;
+    if (!CatFinite(argc, argv, fd[0])) return BUILTIN_EXTERNAL; /* Could block the shell       */
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-")) in = fd[0];
+        else if ((in = open(argv[i], O_RDONLY | O_CLOEXEC)) == -1) {
+            BuiltinError("cat", argv[i]);
+            status = 1;
+            continue;
+        }
+        while ((got = read(in, buf, sizeof(buf))) != 0) {
+            if (got == -1) {
+                if (errno == EINTR) continue;
+                BuiltinError("cat", argv[i]);           /* e.g. Is a directory                      */
+                status = 1;
+                break;
+            }
+            if (WriteAll(fd[1], buf, got)) {
+                BuiltinError("cat", "write error");
+                if (in != fd[0]) close(in);
+                return 1;
+            }
+        }
+        if (in != fd[0]) close(in);
+    }
+    return status;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Parses a whole decimal integer for test's -eq family */
+/* Returns 0, or 1 if it isn't one.                     */
+/* **************************************************** */
+static int TestInt(const char *s, long long *v)
+{
+    char *end;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    while (Check4Space(*end)) end++;
+    return (end == s) || *end || errno;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Checks if word is an operator TestUnary() knows      */
+/* **************************************************** */
+static char IsUnaryOp(const char *op)
+{
+    return (op[0] == '-') && op[1] && !op[2] && (strchr("nztrwxhLbcdefgGkOpsSu", op[1]) != NULL);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Unary file and string tests. Returns 0 true, 1 false */
+/* or 2 if op isn't one of them.                        */
+/* **************************************************** */
+static int TestUnary(const char *op, const char *arg)
+{
+    struct stat st;
+    int got;
+
+    if (!IsUnaryOp(op)) return 2;
+    switch (op[1]) {
+        case 'n': return !*arg;
+        case 'z': return !!*arg;
+        case 't': return !isatty(atoi(arg));
+        case 'r': return access(arg, R_OK) != 0;
+        case 'w': return access(arg, W_OK) != 0;
+        case 'x': return access(arg, X_OK) != 0;
+        case 'h':
+        case 'L': return (lstat(arg, &st) != 0) || !S_ISLNK(st.st_mode);
+    }
+    got = stat(arg, &st) == 0;
+    switch (op[1]) {
+        case 'e': return !got;
+        case 'b': return !got || !S_ISBLK(st.st_mode);
+        case 'c': return !got || !S_ISCHR(st.st_mode);
+        case 'd': return !got || !S_ISDIR(st.st_mode);
+        case 'f': return !got || !S_ISREG(st.st_mode);
+        case 'p': return !got || !S_ISFIFO(st.st_mode);
+        case 'S': return !got || !S_ISSOCK(st.st_mode);
+        case 's': return !got || (st.st_size == 0);
+        case 'g': return !got || !(st.st_mode & S_ISGID);
+        case 'u': return !got || !(st.st_mode & S_ISUID);
+        case 'k': return !got || !(st.st_mode & S_ISVTX);
+        case 'O': return !got || (st.st_uid != geteuid());
+        default:  return !got || (st.st_gid != getegid()); /* -G                                  */
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Binary string, integer and file tests. Returns 0     */
+/* true, 1 false, or 2 if op isn't one of them or an    */
+/* integer is malformed.                                */
+/* **************************************************** */
+static int TestBinary(const char *a, const char *op, const char *b)
+{
+    struct stat sa, sb;
+    long long x, y;
+    int ga, gb;
+
+    if (!strcmp(op, "=") || !strcmp(op, "==")) return strcmp(a, b) != 0;
+    if (!strcmp(op, "!=")) return strcmp(a, b) == 0;
+    if (!strcmp(op, "<"))  return strcmp(a, b) >= 0;
+    if (!strcmp(op, ">"))  return strcmp(a, b) <= 0;
+    if (!strcmp(op, "-a")) return !(*a && *b);
+    if (!strcmp(op, "-o")) return !(*a || *b);
+
+    if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef")) {
+        ga = stat(a, &sa) == 0;
+        gb = stat(b, &sb) == 0;
+        if (op[1] == 'e') return !(ga && gb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino);
+        if (op[1] == 'o') return !(gb && (!ga || sa.st_mtime < sb.st_mtime));
+        return !(ga && (!gb || sa.st_mtime > sb.st_mtime));
+    }
+
+    if (op[0] != '-' || strlen(op) != 3) return 2;
+    if (!strstr("-eq -ne -lt -le -gt -ge", op)) return 2;
+    if (TestInt(a, &x) || TestInt(b, &y)) return 2;
+    switch (op[1] << 8 | op[2]) {
+        case 'e' << 8 | 'q': return !(x == y);
+        case 'n' << 8 | 'e': return !(x != y);
+        case 'l' << 8 | 't': return !(x <  y);
+        case 'l' << 8 | 'e': return !(x <= y);
+        case 'g' << 8 | 't': return !(x >  y);
+        default:             return !(x >= y);  /* -ge */
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Checks if word is an operator TestBinary() knows     */
+/* **************************************************** */
+static char IsBinaryOp(const char *w)
+{
+    static const char *ops[] = {"=", "==", "!=", "<", ">", "-a", "-o", "-nt", "-ot", "-ef",
+                                "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL};
+    int i;
+    for (i = 0; ops[i]; i++)
+        if (!strcmp(w, ops[i])) return 1;
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Recursive descent over test's -o, -a, ! and ( )      */
+/* for more than 4 arguments. *pos is the next word.    */
+/* Returns 0 true, 1 false, 2 on a syntax error.        */
+/* **************************************************** */
+static int TestOr(char **a, int n, int *pos);
+static int TestPrimary(char **a, int n, int *pos)
+{
+    int r;
+    if (*pos >= n) return 2;
+    if (!strcmp(a[*pos], "!")) {
+        (*pos)++;
+        r = TestPrimary(a, n, pos);
+        return (r == 2) ? 2 : !r;
+    }
+    if (!strcmp(a[*pos], "(")) {
+        (*pos)++;
+        r = TestOr(a, n, pos);
+        if ((*pos >= n) || strcmp(a[(*pos)++], ")")) return 2;
+        return r;
+    }
+    if ((*pos + 1 < n) && IsUnaryOp(a[*pos])) {
+        r = TestUnary(a[*pos], a[*pos + 1]);
+        *pos += 2;
+        return r;
+    }
+    if ((*pos + 2 < n) && IsBinaryOp(a[*pos + 1]) && strcmp(a[*pos + 1], "-a") && strcmp(a[*pos + 1], "-o")) {
+        r = TestBinary(a[*pos], a[*pos + 1], a[*pos + 2]);
+        *pos += 3;
+        return r;
+    }
+    return !*a[(*pos)++];                               /* Lone string, true if not empty           */
+}
+static int TestAnd(char **a, int n, int *pos)
+{
+    int r = TestPrimary(a, n, pos), s;
+    while ((r != 2) && (*pos < n) && !strcmp(a[*pos], "-a")) {
+        (*pos)++;
+        if ((s = TestPrimary(a, n, pos)) == 2) return 2;
+        r = r || s;
+    }
+    return r;
+}
+static int TestOr(char **a, int n, int *pos)
+{
+    int r = TestAnd(a, n, pos), s;
+    while ((r != 2) && (*pos < n) && !strcmp(a[*pos], "-o")) {
+        (*pos)++;
+        if ((s = TestAnd(a, n, pos)) == 2) return 2;
+        r = r && s;
+    }
+    return r;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Evaluates n test arguments. Up to 4 arguments follow */
+/* the POSIX rules that go by the argument count, so    */
+/* 'test -f' or 'test ! =' mean what they do in every   */
+/* other test. Returns 0 true, 1 false, 2 on error.     */
+/* **************************************************** */
+static int TestExpr(char **a, int n)
+{
+    int r, pos = 0;
+
+    switch (n) {
+        case 0: return 1;
+        case 1: return !*a[0];
+        case 2:
+            if (!strcmp(a[0], "!")) return !!*a[1];
+            return TestUnary(a[0], a[1]);
+        case 3:
+            if (IsBinaryOp(a[1])) return TestBinary(a[0], a[1], a[2]);
+            if (!strcmp(a[0], "!")) return ((r = TestExpr(a + 1, 2)) == 2) ? 2 : !r;
+            if (!strcmp(a[0], "(") && !strcmp(a[2], ")")) return TestExpr(a + 1, 1);
+            return 2;
+        case 4:
+            if (!strcmp(a[0], "!")) return ((r = TestExpr(a + 1, 3)) == 2) ? 2 : !r;
+            if (!strcmp(a[0], "(") && !strcmp(a[3], ")")) return TestExpr(a + 1, 2);
+    }
+    r = TestOr(a, n, &pos);
+    return (pos == n) ? r : 2;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* test expression / [ expression ] - Anything the      */
+/* builtin can't parse goes to the real test, so errors */
+/* are reported exactly as before.                      */
+/* **************************************************** */
+static int TestMe(int argc, char *argv[], int *fd)
+{
+    int r;
+    if (!strcmp(argv[0], "[")) {                        /* '[' needs its closing ']'                */
+        if (strcmp(argv[argc - 1], "]")) return BUILTIN_EXTERNAL;
+        argc--;
+    }
+    r = TestExpr(argv + 1, argc - 1);
+    return (r == 2) ? BUILTIN_EXTERNAL : r;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Dispatch Table                     */
+/* **************************************************** */
+static const Builtin builtins[] = {
+    {"echo",  EchoMe},
+    {"true",  TrueMe},
+    {"false", FalseMe},
+    {"test",  TestMe},
+    {"[",     TestMe},
+    {"cat",   CatMe},
+    {NULL,    NULL}
+};
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the table entry for name, NULL if not found  */
+/* **************************************************** */
+const Builtin *FindBuiltin(const char *name)
+{
+    const Builtin *B;
+    for (B = builtins; B->name != NULL; B++)
+        if (!strcmp(B->name, name)) return B;
+    return NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the builtin a command can run as: one stage, */
+/* foreground, not fanned out, with no $SSHELL_EXTERNAL */
+/* NULL if it has to be launched                        */
+/* **************************************************** */
+static const Builtin *InShell(Command *C)
+{
+    if ((C->nStages != 1) || C->isBG) return NULL;      /* Needs a process of its own               */
+    if (C->nFanOut) return NULL;                        /* Several '>' files need the relay         */
+    if (getenv("SSHELL_EXTERNAL") != NULL) return NULL; /* Forced to the real binaries              */
+    return FindBuiltin(C->stage[0].argv[0]);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a builtin on fd, with SIGPIPE ignored, so a     */
+/* closed pipe gives the builtin EPIPE instead of       */
+/* killing the shell                                    */
+/* **************************************************** */
+static int CallBuiltin(const Builtin *B, Stage *S, int *fd)
+{
+    struct sigaction ignore, old;
+    int status;
+
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &old);
+    status = B->run(S->argc, S->argv, fd);
+    sigaction(SIGPIPE, &old, NULL);
+    return status;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a one stage foreground command in the shell if  */
+/* it is a builtin utility, on the fds Redirect() opens */
+/* and reports it with CompleteCmd(). Pipelines and     */
+/* background jobs still get processes. Setting         */
+/* $SSHELL_EXTERNAL, or naming the binary with a path,  */
+/* runs the real binaries instead.                      */
+/* Returns 1 if the command was handled, 0 if it still  */
+/* has to be launched.                                  */
+/* **************************************************** */
+char RunBuiltin(Command *C, char *cmd)
+{
+    const Builtin *B;
+    int fd[2], status;
+
+    if ((B = InShell(C)) == NULL) return 0;
+    if (Redirect(&C->stage[0], fd)) return 1;           /* Reported like a failed external launch   */
+    status = CallBuiltin(B, &C->stage[0], fd);
+    if (fd[0] != SI) close(fd[0]);
+    if (fd[1] != SO) close(fd[1]);
+    if (status == BUILTIN_EXTERNAL) return 0;           /* Nothing was done, launch it              */
+    CompleteCmd(cmd, status);
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a $(...) command in the shell if RunBuiltin()   */
+/* would, with what it prints to STDOUT going to out,   */
+/* and nothing reported. out is left open.              */
+/* Returns its exit status, EXIT_FAILURE if a file      */
+/* won't open, or BUILTIN_EXTERNAL if it has to be      */
+/* launched                                             */
+/* **************************************************** */
+int CaptureBuiltin(Command *C, int out)
+{
+    const Builtin *B;
+    int fd[2], status;
+
+    if ((B = InShell(C)) == NULL) return BUILTIN_EXTERNAL;
+    if (Redirect(&C->stage[0], fd)) return EXIT_FAILURE;
+    if (fd[1] == SO) fd[1] = out;                       /* Unless a '>' file took the output        */
+    status = CallBuiltin(B, &C->stage[0], fd);
+    if (fd[0] != SI) close(fd[0]);
+    if ((fd[1] != SO) && (fd[1] != out)) close(fd[1]);
+    return status;
+}
+/* **************************************************** */
@@ -0,0 +1,26 @@
+#ifndef _BUILTIN_H
+#define _BUILTIN_H
+
+/* **************************************************** */
+/*                  Builtin Structures                  */
+/* **************************************************** */
+#define BUILTIN_EXTERNAL -1                             /* Builtin can't handle it, run the real binary     */
+#define BUILTIN_CHUNK    65536                          /* Bytes moved by each read() in 'cat'              */
+
+typedef int (*BuiltinFn)(int argc, char *argv[], int *fd); /* Exit status, or BUILTIN_EXTERNAL              */
+
+typedef struct Builtin {                                /* Utility the shell runs without a process         */
+    const char *name;                                   /* Command name, as typed                           */
+    BuiltinFn run;                                      /* Runs it on the stage's redirect fds              */
+} Builtin;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Builtin Functions                  */
+/* **************************************************** */
+const Builtin *FindBuiltin(const char *name);           /* Table entry for name, NULL if not a builtin      */
+char RunBuiltin(Command *C, char *cmd);                 /* Runs a one stage command in the shell, 1 if done */
+int CaptureBuiltin(Command *C, int out);                /* Same for a $(...), its STDOUT goes to out        */
+/* **************************************************** */
+
+#endif
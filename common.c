@@ -1,77 +1,107 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "common.h"
 
 /* **************************************************** */
 /*               Shell Print Characters                 */
 /* **************************************************** */
 const char *SHELL_PROMPT   = "sshell$ ";
+const char *HERE_PROMPT    = "> ";
 const char *EXITLINE       = "Bye...\n";
 const char *HELLO          = "Hello!\n";
 const char *BELL           = "\a";
 const char *NEWLINE        = "\n";
-const char *BACKSPACE_CHAR = "\b \b";
 /* **************************************************** */
+static OutBuf out = {STDOUT_FILENO, 0};                 /* Everything the shell prints itself       */
+static const char *direct;                              /* Set by Emit() for oversized output       */
 /* **************************************************** */
-/*                  Sound Bell noise                    */
 /* **************************************************** */
-void ErrorBell(void)
+/* Queues terminal output. Output for one event, e.g. a */
+/* history redraw, goes out in one write() instead of   */
+/* one per character. Switching between STDOUT and      */
+/* STDERR flushes first, so the order never changes.    */
+/* **************************************************** */
+void Emit(int fd, const char *buf, size_t len)
 {
-    write(STDERR_FILENO, BELL, 1);
+    if ((fd != out.fd) || (out.len + len > OUT_BUFFER)) {
+        FlushOut();
+        out.fd = fd;
+    }
+    if (len > OUT_BUFFER) {                             /* Too big to queue, e.g. a long command    */
+        direct  = buf;
+        out.len = len;
+        FlushOut();                                     /* Written straight from the caller's copy  */
+        return;
+    }
+    memcpy(out.buf + out.len, buf, len);
+    out.len += len;
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Prints the exit message.                             */
+/* Writes the queued output. Called before anything     */
+/* else can write to the terminal (launching a child,   */
+/* running a builtin) and before blocking for input or  */
+/* a child, so queued output is never left waiting.     */
 /* **************************************************** */
-void SayGoodbye (void)
+void FlushOut(void)
 {
-    write(STDERR_FILENO, EXITLINE, strlen(EXITLINE));
+    const char *p = direct ? direct : out.buf;
+    ssize_t put;
+
+    while (out.len) {
+        if ((put = write(out.fd, p, out.len)) == -1) {
+            if (errno == EINTR) continue;
+            break;                                      /* Terminal is gone, drop it                */
+        }
+        p += put;
+        out.len -= put;
+    }
+    out.len = 0;
+    direct = NULL;
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Prints the welcome message. Removed for auto-testing */
+/*                  Sound Bell noise                    */
 /* **************************************************** */
-void SayHello (void)
+void ErrorBell(void)
 {
-//    write(STDERR_FILENO, HELLO, strlen(HELLO));
+    Emit(STDERR_FILENO, BELL, 1);
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Prints the backspace character to STDOUT             */
+/* Prints the exit message.                             */
 /* **************************************************** */
-void PrintBackspace (void)
+void SayGoodbye (void)
 {
-    write(STDOUT_FILENO, BACKSPACE_CHAR, strlen(BACKSPACE_CHAR));
+    Emit(STDERR_FILENO, EXITLINE, strlen(EXITLINE));
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Prints the newline character to STDOUT               */
+/* Prints the welcome message. Removed for auto-testing */
 /* **************************************************** */
-void PrintNL (void)
+void SayHello (void)
 {
-    write(STDOUT_FILENO, NEWLINE, strlen(NEWLINE));
+//    write(STDERR_FILENO, HELLO, strlen(HELLO));
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Displace the main sshell$ prompt                     */
+/* Prints the newline character to STDOUT               */
 /* **************************************************** */
-void DisplayPrompt(int *cursorPos)
+void PrintNL (void)
 {
-    write(STDOUT_FILENO, SHELL_PROMPT, strlen(SHELL_PROMPT));
-    *cursorPos = 0;
+    Emit(STDOUT_FILENO, NEWLINE, strlen(NEWLINE));
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Clear the current cmdLine buffer and STDIN           */
+/* Displace the main sshell$ prompt                     */
 /* **************************************************** */
-void ClearCmdLine(char *cmdLine, int *cursorPos)
+void DisplayPrompt(void)
 {
-    while (*cursorPos) {
-        write(STDOUT_FILENO, BACKSPACE_CHAR, strlen(BACKSPACE_CHAR));
-        *cursorPos -= 1;
-    }
+    Emit(STDOUT_FILENO, SHELL_PROMPT, strlen(SHELL_PROMPT));
 }
 /* **************************************************** */
 /* **************************************************** */
@@ -79,9 +109,8 @@ void ClearCmdLine(char *cmdLine, int *cursorPos)
 /* **************************************************** */
 void ThrowError (char *msg)
 {
-    char *newMsg = (char *) malloc(strlen(msg)+2);
-    sprintf(newMsg, "%s\n", msg);
-    write(STDERR_FILENO, newMsg, strlen(newMsg));
+    Emit(STDERR_FILENO, msg, strlen(msg));
+    Emit(STDERR_FILENO, NEWLINE, 1);                    /* Goes out with the message              */
 }                    
 /* **************************************************** */
 /* **************************************************** */
@@ -129,10 +158,12 @@ void BadOutputRedirect (void)
 /* **************************************************** */
 void CompleteCmd (char *cmd, int exitCode)
 {
-    char msg[MAX_BUFFER + 25];
-    sprintf(msg, "+ completed '%s' [%d]\n", cmd, exitCode);
+    char tail[24];                                      /* "' [code]\n"                             */
+    int len = sprintf(tail, "' [%d]\n", exitCode);
 
-    write(STDERR_FILENO, msg, strlen(msg));
+    Emit(STDERR_FILENO, "+ completed '", 13);           /* Queued with the rest of the event        */
+    Emit(STDERR_FILENO, cmd, strlen(cmd));
+    Emit(STDERR_FILENO, tail, len);
 }
 /* **************************************************** */
 /* **************************************************** */
@@ -160,41 +191,6 @@ char Check4Special(char key)
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Strips trailing and leading whitespace.              */
-/* **************************************************** */
-char *RemoveWhitespace(char *string)
-{
-    int i = strlen(string) - 1;                         /* String length, -1 to acct for offset     */
-    while (Check4Space(string[i])) string[i--] = '\0';  /* Remove trailing whitespace               */
-    while (Check4Space(*string))   string++;            /* Remove leading whitespace                */
-    return string;                                      /* Return updated start address of string   */
-}
-/* **************************************************** */
-/* **************************************************** */
-/* Ensures a space before and after <>& characters      */
-/* **************************************************** */
-char *InsertSpaces(char *cmd)
-{
-    char cVal;
-    char *newCmd = (char *) malloc(2*MAX_BUFFER);       /* Ensure buffer is big enough to hold cmd w/ new spaces */
-    char specialChar[] = "<>&";                         /* Special characters to insert spaces before and after  */
-    char *sLoc  = strpbrk(cmd, specialChar);            /* Points to first occurance of (<> or &)                */
-    
-    while(sLoc != NULL) {                               /* Repeat until no more <>& are found                    */
-        cVal = Check4Special(*sLoc);                    /* Save the type of character it is (<> or &)            */
-        *sLoc = '\0';                                   /* Terminate the string                                  */
-        sprintf(newCmd, "%s%s %c ", newCmd, cmd, cVal); /* Add spaces before and after the character             */
-        cmd = sLoc+1;
-        sLoc = strpbrk(cmd, specialChar);               /* Points to the next occurance of (<> or &)             */
-    }
-    
-    if (*cmd != '\0')	                                /* If there are still characters in command              */
-        sprintf(newCmd, "%s%s",newCmd,cmd);             /* Copy them to newCmd                                   */
-
-    return newCmd;                                      /* Return the pointer                                    */
-}
-/* **************************************************** */
-/* **************************************************** */
 /* Run dup2() and close(). Handle errors.               */
 /* **************************************************** */
 void Dup2AndClose(int old, int bnew)                    /* new is already a keyword                    */
@@ -211,40 +207,45 @@ void Dup2AndClose(int old, int bnew)                    /* new is already a keyw
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Check for invalid placement of special characters    */
-/* Set background flag if '&' is last character         */
-/* Then remove '&' from the string                      */
+/* Longest command line the shell accepts. Anything     */
+/* longer couldn't be passed to execvp() anyway.        */
 /* **************************************************** */
-char CheckCommand(char *cmd, char *isBackground)
+size_t ArgMax(void)
 {
-    char s  = *cmd;                                     /* Get the first character in the array       */
-    char *end = strchr(cmd, '\0')-1;                    /* Get the last character in the array        */
-    switch (*end){                                      /* Check the character at the end             */
-	    case '|':
-            InvalidCommand();                           /* Invalid command line error                 */
-		    return 1;                           /* Bad command, return 1                      */
-
-	    case '>':
-		    if (s != *end) NoOutputFile();      /* If > is not the only character in the cmd  */
-            else InvalidCommand();                      /* Otherwise Throw invalid command error      */
-            return 1;                                   /* Bad command, return 1                      */
-
-        case '<':
-            if (s != *end) NoInputFile();               /* If > is not the only character in the cmd  */  
-            else InvalidCommand();                      /* Otherwise Throw invalid command error      */
-            return 1;                                   /* Bad command, return 1                      */
-    }
-
-    if (s == '|' || Check4Special(s)) {                 /* Check the character at the beginning       */
-        InvalidCommand();
-        return 1;
-    }
+    static long argMax;                                 /* sysconf() is only asked once             */
+    if (argMax <= 0) argMax = sysconf(_SC_ARG_MAX);
+    if (argMax <= 0) argMax = 131072;                   /* POSIX doesn't have to say, assume 128K   */
+    return argMax;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Start a line buffer on its own stack storage         */
+/* **************************************************** */
+void InitLine(LineBuf *L)
+{
+    L->buf  = L->small;
+    L->size = LINE_STACK;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Makes room for need bytes by doubling the buffer.    */
+/* The first time, the line moves off the stack.        */
+/* Returns 0 if need is past ArgMax(), 1 otherwise.     */
+/* **************************************************** */
+char GrowLine(LineBuf *L, size_t need)
+{
+    size_t size = L->size;
+    if (need <= size) return 1;                         /* Already big enough                       */
+    if (need > ArgMax()) return 0;                      /* Too long to ever run                     */
 
-    if (*end == '&') {                                  /* If '&' is last character                   */
-        *isBackground = 1;                              /* Set the Background flag                    */
-        *end = '\0';                                    /* Remove '&' from the command                */
-    }
-    return 0;
+    while (size < need) size *= 2;                      /* Amortized O(1) per byte                  */
+    if (L->buf == L->small) {                           /* Leaving the stack                        */
+        L->buf = (char *) malloc(size);
+        memcpy(L->buf, L->small, L->size);
+    } else
+        L->buf = (char *) realloc(L->buf, size);
+    L->size = size;
+    return 1;
 }
 /* **************************************************** */
 
@@ -252,36 +253,37 @@ char CheckCommand(char *cmd, char *isBackground)
 /* Searches the PATH variable for the location of       */
 /* the specified program                                */
 /* Uses the first entry in PATH that has valid entry    */
-/*                                                      */
-/*   Works excellent, but not needed if execvp() used.  */
-/*                      * sigh *                        */
+/* PATH is only read, never split in place.             */
 /*                                                      */
 /* Example - *PATH = /usr/bin:/opt/bin                  */
 /*           *prog = "ls"                               */
 /*           returns "/usr/bin/ls"                      */
+/* Returns a malloc'd path, or NULL if nothing matched  */
 /* **************************************************** */
-//char *SearchPath(char *prog) {
-//    unsigned int len = strlen(prog);                  /* Length of the string of the passed program  */
-//    char *binary  = (char *) malloc(MAX_BUFFER+len);  /* Pointer to hold the full name of the binary */
-//    char *PATH = getenv("PATH");                      /* Store contents of the PATH variable         */
-//    char *semi = strchr(PATH, ':');                   /* semi points to the first place ':' occurs   */
-//    while(semi != NULL) {                             /* Repeat until no more ':' found              */
-//        *semi = '\0';                                 /* Terminate the string where ':' was          */
-//        sprintf(binary, "%s/%s", PATH, prog);         /* Append the first path to binary name        */
-//        if(access(binary, F_OK) != -1)                /* If binary exists                            */
-//            return binary;                            /* Return the full name of the binary          */
-//        PATH = semi+1;                                /* Update the address PATH points to           */
-//        semi = strchr(PATH, ':');                     /* semi points to the next place ':' occurs    */
-//    }
-//
-//    sprintf(binary, "%s/%s", PATH, prog);             /* Append binary to last entry in path         */
-//    if(access(binary, F_OK) != -1)                    /* If binary exists                            */
-//        return binary;
-//    else                                              /* If it doesn't exists                        */
-//        binary = prog;                                /* Just store the argument that was passed     */
-//    
-//    return binary;                                    /* Return the binary name                      */
-//}
+char *SearchPath(const char *prog, const char *PATH)
+{
+    size_t len = strlen(prog);                          /* Length of the string of the passed program  */
+    size_t dirLen;
+    char *binary = (char *) malloc(strlen(PATH) + len + 3); /* Room for the longest dir + '/' + prog   */
+    const char *semi;
+    struct stat st;
+
+    while (1) {
+        semi = strchr(PATH, ':');                       /* semi points to the next place ':' occurs    */
+        if (semi == NULL) semi = PATH + strlen(PATH);   /* or to the end of the last entry             */
+        dirLen = semi - PATH;
+        if (dirLen == 0) binary[dirLen++] = '.';        /* An empty entry means the current directory  */
+        else memcpy(binary, PATH, dirLen);
+        binary[dirLen] = '/';                           /* Append the program to the directory         */
+        memcpy(binary + dirLen + 1, prog, len + 1);
+        if ((access(binary, X_OK) == 0) && (stat(binary, &st) == 0) && S_ISREG(st.st_mode))
+            return binary;                              /* Same file execvp() would have run           */
+        if (*semi == '\0') break;                       /* That was the last entry in PATH             */
+        PATH = semi + 1;                                /* Update the address PATH points to           */
+    }
+    free(binary);
+    return NULL;                                        /* Not anywhere on PATH                        */
+}
 /* **************************************************** */
 
 /* **************************************************** */
@@ -1,18 +1,42 @@
 #ifndef _COMMON_H
 #define _COMMON_H
  
+#include <stddef.h>
+
 /* **************************************************** */
-/*                Spec-Defined Assumptions              */
+/*                     Buffer Sizes                     */
 /* **************************************************** */
-#define MAX_BUFFER    512
-#define MAX_TOKENS     16
-#define MAX_TOKEN_LEN  32
-#define MAX_HIST_ITEMS 10
+#define LINE_STACK    512                               /* Line bytes kept on the stack before it grows         */
+#define TOKEN_CHUNK    16                               /* First argv slots & stages, doubled when they fill up */
+
+typedef struct LineBuf {                                /* Command line being typed                             */
+    char *buf;                                          /* Points at small until the line outgrows it           */
+    size_t size;                                        /* Capacity of buf                                      */
+    char small[LINE_STACK];                             /* Short lines never touch malloc                       */
+} LineBuf;
+
+#define OUT_BUFFER   4096                               /* Terminal output held back until the next flush       */
+
+typedef struct OutBuf {                                 /* Terminal output queued for one write()               */
+    int fd;                                             /* STDOUT or STDERR, switching fds flushes first        */
+    size_t len;                                         /* Bytes queued                                         */
+    char buf[OUT_BUFFER];
+} OutBuf;
 
 /* **************************************************** */
 /*                    Keystroke Codes                   */
 /* **************************************************** */
+#define CTRL_A       0x01
+#define CTRL_B       0x02
+#define CTRL_C       0x03
 #define CTRL_D       0x04
+#define CTRL_E       0x05
+#define CTRL_F       0x06
+#define CTRL_H       0x08
+#define CTRL_K       0x0B
+#define CTRL_R       0x12
+#define CTRL_U       0x15
+#define CTRL_W       0x17
 #define TAB          0x09
 #define RETURN       0x0A
 #define BACKSPACE    0x7F
@@ -22,6 +46,9 @@
 #define DOWN         0x42
 #define RIGHT        0x43
 #define LEFT         0x44
+#define HOME         0x48
+#define END          0x46
+#define SS3          0x4F                               /* ESC O, how some terminals send HOME and END          */
 
 /* **************************************************** */
 /*                     Convenience                      */
@@ -33,6 +60,9 @@
 #define SO           STDOUT_FILENO
 #define SE           STDERR_FILENO
 
+extern const char *SHELL_PROMPT;                        /* Printed before each command line                     */
+extern const char *HERE_PROMPT;                         /* Printed before each here-document line               */
+
 /* **************************************************** */
 /*                   Common functions                   */
 /* **************************************************** */
@@ -40,11 +70,15 @@ void SayHello (void);                                   /* Prints the hello mess
 void SayGoodbye (void);                                 /* Prints the exit message                              */
 void ErrorBell(void);                                   /* Sound Bell noise                                     */
 void PrintNL (void);                                    /* Prints the newline character to STDOUT               */
-void PrintBackspace (void);                             /* Prints Backspace character to STDOUT                 */
-void ClearCmdLine (char *cmdLine, int *cursorPos);      /* Clear the current cmdLine buffer and STDIN           */
-void DisplayPrompt (int *cursorPos);                    /* Displace the main sshell$ prompt                     */
+void DisplayPrompt (void);                              /* Displace the main sshell$ prompt                     */
 void CompleteCmd (char *cmd, int exitCode);             /* Prints + completed messages to STDOUT                */
 void Dup2AndClose(int old, int bnew);                   /* Runs dup2() and close(), performs error checking     */
+size_t ArgMax(void);                                    /* Longest command line the shell accepts               */
+void InitLine(LineBuf *L);                              /* Start a line buffer on its stack storage             */
+char GrowLine(LineBuf *L, size_t need);                 /* Make room for need bytes, 0 if past ArgMax()         */
+char *SearchPath(const char *prog, const char *PATH);   /* Returns the full path of the binary, NULL if none    */
+void Emit(int fd, const char *buf, size_t len);         /* Queue terminal output until the next FlushOut()      */
+void FlushOut(void);                                    /* Write everything queued with a single write()        */
 /* **************************************************** */
 /*                    Error functions                   */
 /* **************************************************** */
@@ -57,15 +91,11 @@ void BadOutputRedirect (void);                          /* Prints Error: misloca
 /* **************************************************** */
 /*                  Parsing functions                   */
 /* **************************************************** */
-char CheckCommand(char *cmd, char *isBackground);   	/* Check for invalid placement of special characters    */
 char Check4Space(char key);                             /* Checks if character is whitespace or not             */
 char Check4Special(char key);                           /* Checks if special character of not                   */
-char *RemoveWhitespace(char *string);                   /* Strips trailing and leading whitespace from a string */
-char *InsertSpaces(char *cmd);                          /* Ensures ' ' before and after all <>& characters      */
 /* ******************************************************/
 /*                  Unused functions                    */
 /* ******************************************************/
-//char *SearchPath(char *prog);	                        /* Returns a pointer to the full path specified binary  */
 //ExecProgram(**Cmds[], N, Process *P);                 /* Function to execute a command. Recursive if piped    */
 /* **************************************************** */
 
@@ -0,0 +1,381 @@
+#define _GNU_SOURCE                                     /* getdents64()                             */
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "complete.h"
+
+/* **************************************************** */
+static CmdIndex commands;                               /* Built by the first command completion    */
+static const char *KEYWORDS[] = {"bg", "cd", "exit", "export", "fg", "hash", "jobs", "kill", "parallel", "pwd", "source", "time", "unset", "wait", NULL}; /* Not found in PATH   */
+/* **************************************************** */
+
+/* **************************************************** */
+/* Adds an empty node to the pool. The pool may move,   */
+/* so nodes are only ever referred to by index.         */
+/* **************************************************** */
+static uint32_t NewNode(char key)
+{
+    TrieNode *N;
+
+    if (commands.nodes == commands.size) {              /* Full, double it                          */
+        commands.size = commands.size ? commands.size * 2 : 1024;
+        commands.node = (TrieNode *) realloc(commands.node, commands.size * sizeof(TrieNode));
+    }
+    N = &commands.node[commands.nodes];
+    memset(N, 0, sizeof(TrieNode));
+    N->key = key;
+    return commands.nodes++;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the child of parent for key, adding it in    */
+/* byte order if create is set. Returns 0 if none.      */
+/* **************************************************** */
+static uint32_t Child(uint32_t parent, char key, char create)
+{
+    uint32_t prev = 0, n = commands.node[parent].child, made;
+
+    while (n && ((unsigned char) commands.node[n].key < (unsigned char) key)) {
+        prev = n;
+        n = commands.node[n].sibling;
+    }
+    if (n && (commands.node[n].key == key)) return n;
+    if (!create) return 0;
+
+    made = NewNode(key);
+    commands.node[made].sibling = n;
+    if (prev) commands.node[prev].sibling = made;
+    else commands.node[parent].child = made;
+    return made;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Adds (delta 1) or removes (delta -1) one copy of a   */
+/* name. Nodes are never freed, a name that comes back  */
+/* reuses them, and empty ones are skipped by 'below'.  */
+/* **************************************************** */
+static void AddName(const char *name, int delta)
+{
+    uint32_t n = 0;
+
+    commands.node[0].below += delta;
+    for (; *name; name++) {
+        if (!(n = Child(n, *name, delta > 0))) return;  /* Was never added                          */
+        commands.node[n].below += delta;
+    }
+    commands.node[n].names += delta;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Reads a PATH directory with getdents64() and adds    */
+/* the executables in it to the trie. They are saved in */
+/* the directory's list, so they can be removed again   */
+/* if the directory changes.                            */
+/* **************************************************** */
+static void ScanPathDir(PathDir *D, int fd)
+{
+    char buf[DIR_CHUNK];
+    struct stat st;
+    ssize_t n, off;
+    size_t len;
+    DirEnt *d;
+
+    while ((n = getdents64(fd, buf, sizeof(buf))) > 0)
+        for (off = 0; off < n; off += d->d_reclen) {
+            d = (DirEnt *) (buf + off);
+            if (d->d_type == DT_DIR) continue;          /* Includes '.' and '..'                    */
+            if ((d->d_type != DT_REG) &&                /* Links and unknown types need a look      */
+                (fstatat(fd, d->d_name, &st, 0) || !S_ISREG(st.st_mode)))
+                continue;
+            if (faccessat(fd, d->d_name, X_OK, 0)) continue;
+
+            len = strlen(d->d_name) + 1;
+            if (D->len + len > D->size) {
+                D->size = (D->len + len) * 2;
+                D->names = (char *) realloc(D->names, D->size);
+            }
+            memcpy(D->names + D->len, d->d_name, len);
+            D->len += len;
+            AddName(d->d_name, 1);
+        }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Starts the trie over for a new PATH. Directories are */
+/* only read by RefreshCommands().                      */
+/* **************************************************** */
+static void NewPATH(const char *PATH)
+{
+    const char *p, *colon;
+    int i;
+
+    for (i = 0; i < commands.nDirs; i++) {
+        free(commands.dirs[i].dir);
+        free(commands.dirs[i].names);
+    }
+    free(commands.dirs);
+    free(commands.PATH);
+    commands.PATH = strdup(PATH);
+
+    commands.nDirs = 1;
+    for (p = PATH; *p; p++)
+        if (*p == ':') commands.nDirs++;
+    commands.dirs = (PathDir *) calloc(commands.nDirs, sizeof(PathDir));
+    for (i = 0, p = PATH; i < commands.nDirs; i++, p = colon + 1) {
+        if ((colon = strchr(p, ':')) == NULL) colon = p + strlen(p);
+        commands.dirs[i].dir = (colon == p) ? strdup(".") : strndup(p, colon - p);  /* Empty means cwd */
+    }
+
+    commands.nodes = 0;
+    NewNode('\0');                                      /* Root                                     */
+    for (i = 0; KEYWORDS[i] != NULL; i++)
+        AddName(KEYWORDS[i], 1);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Brings the trie up to date. Each PATH directory is   */
+/* stat()ed, and only one whose mtime changed since it  */
+/* was read is read again, so the usual cost is one     */
+/* stat() per directory.                                */
+/* **************************************************** */
+static void RefreshCommands(void)
+{
+    const char *PATH = getenv("PATH");
+    struct stat st;
+    PathDir *D;
+    char *p;
+    int i, fd;
+
+    if (PATH == NULL) PATH = "/bin:/usr/bin";           /* Same default execvp() uses               */
+    if ((commands.PATH == NULL) || strcmp(commands.PATH, PATH))
+        NewPATH(PATH);
+
+    for (i = 0; i < commands.nDirs; i++) {
+        D = &commands.dirs[i];
+        if (stat(D->dir, &st))                          /* Gone, drop what it had                   */
+            st.st_mtim.tv_sec = st.st_mtim.tv_nsec = 0;
+        if ((st.st_mtim.tv_sec == D->mtime.tv_sec) && (st.st_mtim.tv_nsec == D->mtime.tv_nsec))
+            continue;                                   /* Unchanged                                */
+
+        for (p = D->names; p < D->names + D->len; p += strlen(p) + 1)
+            AddName(p, -1);
+        D->len = 0;
+        D->mtime = st.st_mtim;
+        if (st.st_mtim.tv_sec && ((fd = open(D->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) != -1)) {
+            ScanPathDir(D, fd);
+            close(fd);
+        }
+    }
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Saves a match and shortens the prefix every match    */
+/* has in common                                        */
+/* **************************************************** */
+static void AddMatch(Matches *M, const char *name)
+{
+    size_t i;
+
+    if (M->count == M->size) {                          /* Double the array                         */
+        M->name = M->size ? (char **) ArenaGrow(M->A, M->name, M->size * sizeof(char *), 2 * M->size * sizeof(char *))
+                          : (char **) ArenaAlloc(M->A, 64 * sizeof(char *));
+        M->size = M->size ? M->size * 2 : 64;
+    }
+    M->name[M->count] = ArenaDup(M->A, name);
+    if (!M->count)
+        M->common = strlen(name);
+    else {
+        for (i = 0; (i < M->common) && (M->name[0][i] == name[i]); i++);
+        M->common = i;
+    }
+    M->count++;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Adds every name under a trie node, in byte order     */
+/* **************************************************** */
+static void Collect(uint32_t n, char *name, size_t len, Matches *M)
+{
+    for (n = commands.node[n].child; n; n = commands.node[n].sibling) {
+        if (!commands.node[n].below) continue;          /* Every name down here was removed         */
+        name[len] = commands.node[n].key;
+        name[len + 1] = '\0';
+        if (commands.node[n].names) AddMatch(M, name);
+        Collect(n, name, len + 1, M);
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Finds the command names starting with prefix. The    */
+/* trie is walked down to the prefix, so only names     */
+/* that match are ever looked at. Returns the count.    */
+/* **************************************************** */
+size_t CompleteCommand(const char *prefix, Matches *M)
+{
+    char name[NAME_MAX + 2];
+    size_t len = strlen(prefix);
+    uint32_t n = 0;
+    const char *p;
+
+    RefreshCommands();
+    if (len > NAME_MAX) return 0;
+    for (p = prefix; *p; p++)
+        if (!(n = Child(n, *p, 0))) return 0;
+    if (!commands.node[n].below) return 0;
+
+    strcpy(name, prefix);
+    if (commands.node[n].names) AddMatch(M, name);
+    Collect(n, name, len, M);
+    return M->count;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Finds the files matching the part of word after its  */
+/* last '/', in the directory before it. Entries are    */
+/* streamed with getdents64(). Once the scan has taken */
+/* COMPLETE_WAIT ms, STDIN is polled after each chunk,  */
+/* so a key typed while a huge directory is read stops  */
+/* the completion instead of waiting for it.            */
+/* A lone directory match gets a '/' added.             */
+/* Returns 0 if a key stopped it, 1 otherwise.          */
+/* **************************************************** */
+char CompleteFile(const char *word, Matches *M)
+{
+    const char *slash = strrchr(word, '/'), *prefix = slash ? slash + 1 : word;
+    size_t plen = strlen(prefix), dlen = slash ? slash - word + 1 : 0;
+    struct pollfd key = {SI, POLLIN, 0};
+    struct timespec begin, now;
+    char buf[DIR_CHUNK], dir[PATH_MAX], *name;
+    struct stat st;
+    ssize_t n, off;
+    DirEnt *d;
+    int fd;
+
+    if (dlen >= PATH_MAX) return 1;
+    memcpy(dir, dlen ? word : ".", dlen ? dlen : 2);
+    if (dlen) dir[dlen] = '\0';
+    if ((fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) return 1;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    while ((n = getdents64(fd, buf, sizeof(buf))) > 0) {
+        for (off = 0; off < n; off += d->d_reclen) {
+            d = (DirEnt *) (buf + off);
+            if ((d->d_name[0] == '.') && (prefix[0] != '.')) continue;  /* Hidden unless asked for */
+            if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..")) continue;
+            if (!strncmp(d->d_name, prefix, plen)) AddMatch(M, d->d_name);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (((now.tv_sec - begin.tv_sec) * 1000 + (now.tv_nsec - begin.tv_nsec) / 1000000 >= COMPLETE_WAIT) &&
+            (poll(&key, 1, 0) == 1)) {                  /* Typing goes on, drop the completion      */
+            close(fd);
+            return 0;
+        }
+    }
+
+    if ((M->count == 1) && !fstatat(fd, M->name[0], &st, 0) && S_ISDIR(st.st_mode)) {
+        name = (char *) ArenaAlloc(M->A, M->common + 2);
+        memcpy(name, M->name[0], M->common);
+        strcpy(name + M->common, "/");
+        M->name[0] = name;
+        M->common++;
+    }
+    close(fd);
+    return 1;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Sorts the matches for listing                        */
+/* **************************************************** */
+static int ByName(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Lists the matches in columns under the line, then    */
+/* redraws the prompt and the line                      */
+/* **************************************************** */
+static void ListMatches(Editor *E, Matches *M)
+{
+    size_t width = TermWidth(), shown = M->count, widest = 0, cols, i, len;
+    char more[64];
+
+    if (!width) width = 80;
+    if (shown > COMPLETE_LIST) shown = COMPLETE_LIST;
+    qsort(M->name, M->count, sizeof(char *), ByName);
+    for (i = 0; i < shown; i++)
+        if ((len = strlen(M->name[i])) > widest) widest = len;
+    cols = width / (widest + 2);
+    if (!cols) cols = 1;
+
+    LeaveLine(E);
+    PrintNL();
+    for (i = 0; i < shown; i++) {
+        len = strlen(M->name[i]);
+        Emit(SO, M->name[i], len);
+        if (((i + 1) % cols == 0) || (i + 1 == shown))
+            PrintNL();
+        else
+            while (len++ < widest + 2) Emit(SO, " ", 1);
+    }
+    if (M->count > shown)
+        Emit(SO, more, snprintf(more, sizeof(more), "... %zu more\n", M->count - shown));
+    DisplayPrompt();
+    RedrawLine(E);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Completes the word before the cursor. The first word */
+/* of a stage is completed from the command trie, the   */
+/* rest and anything with a '/' from the file system.   */
+/* One match is put in full, followed by a space, or a  */
+/* '/' for a directory. Several are extended to what    */
+/* they share, and listed if that adds nothing.         */
+/* **************************************************** */
+void CompleteLine(Editor *E)
+{
+    char *line = E->text.buf, *word, *slash;            /* Bytes before the cursor are in one piece */
+    size_t end = E->gapStart, start = end, i, plen;
+    Matches M = {NewArena(), NULL, 0, 0, 0};
+    char command;
+
+    while (start && !Check4Space(line[start - 1]) && !Check4Special(line[start - 1]) && (line[start - 1] != '|'))
+        start--;
+    for (i = start; i && Check4Space(line[i - 1]); i--);
+    command = !i || (line[i - 1] == '|');               /* First word of a stage                    */
+
+    word = (char *) ArenaAlloc(M.A, end - start + 1);
+    memcpy(word, line + start, end - start);
+    word[end - start] = '\0';
+    slash = strrchr(word, '/');
+    plen = slash ? strlen(slash + 1) : end - start;     /* Part of word the matches start with      */
+
+    if (command && (slash == NULL))
+        CompleteCommand(word, &M);
+    else if (!CompleteFile(word, &M)) {                 /* Stopped by a key, which is handled next  */
+        FreeArena(M.A);
+        return;
+    }
+
+    if (!M.count)
+        ErrorBell();
+    else if ((M.count == 1) || (M.common > plen)) {
+        for (i = plen; i < M.common; i++)
+            if (!InsertKey(E, M.name[0][i])) break;     /* Line can't get any longer                */
+        if ((M.count == 1) && (M.name[0][M.common - 1] != '/'))
+            InsertKey(E, ' ');
+    } else
+        ListMatches(E, &M);
+    FreeArena(M.A);
+}
+/* **************************************************** */
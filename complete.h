@@ -0,0 +1,67 @@
+#ifndef _COMPLETE_H
+#define _COMPLETE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "arena.h"                                      /* Matches are collected in an arena                */
+#include "editor.h"                                     /* Command line being typed                         */
+
+/* **************************************************** */
+/*                 Completion Structures                */
+/* **************************************************** */
+#define DIR_CHUNK     32768                             /* Bytes of entries fetched by each getdents64()    */
+#define COMPLETE_LIST 100                               /* Most matches listed under the prompt             */
+#define COMPLETE_WAIT 20                                /* ms a file scan runs before a key can stop it     */
+
+typedef struct DirEnt {                                 /* Entry as getdents64() returns it                 */
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;                            /* Bytes to the next entry                          */
+    unsigned char d_type;                               /* DT_DIR, DT_REG, ... or DT_UNKNOWN                */
+    char d_name[];
+} DirEnt;
+
+typedef struct TrieNode {                               /* One byte of one or more command names            */
+    uint32_t child;                                     /* First child, 0 if none (the root is node 0)      */
+    uint32_t sibling;                                   /* Next child of the same parent, in byte order     */
+    uint32_t names;                                     /* PATH directories holding the name ending here    */
+    uint32_t below;                                     /* Names ending here or further down                */
+    char key;
+} TrieNode;
+
+typedef struct PathDir {                                /* One PATH directory and what it added to the trie */
+    char *dir;                                          /* As written in PATH                               */
+    struct timespec mtime;                              /* When it was scanned, 0 if it couldn't be read    */
+    char *names;                                        /* Executables found, '\0' separated                */
+    size_t len;                                         /* Bytes used in names                              */
+    size_t size;                                        /* Capacity of names                                */
+} PathDir;
+
+typedef struct CmdIndex {                               /* Every command name PATH gives, as a prefix trie  */
+    char *PATH;                                         /* Copy of the PATH the trie was built from         */
+    PathDir *dirs;                                      /* PATH directories, in order                       */
+    int nDirs;
+    TrieNode *node;                                     /* Node pool, node 0 is the root                    */
+    uint32_t nodes;                                     /* Nodes used                                       */
+    uint32_t size;                                      /* Capacity of the pool                             */
+} CmdIndex;
+
+typedef struct Matches {                                /* Completions of the word before the cursor        */
+    Arena *A;                                           /* Holds the names and the array of them            */
+    char **name;
+    size_t count;
+    size_t size;                                        /* Capacity of name                                 */
+    size_t common;                                      /* Bytes every match starts with                    */
+} Matches;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                 Completion Functions                 */
+/* **************************************************** */
+void CompleteLine(Editor *E);                           /* TAB, completes the word before the cursor        */
+size_t CompleteCommand(const char *prefix, Matches *M); /* Command names starting with prefix, from the trie */
+char CompleteFile(const char *word, Matches *M);        /* File names matching word, 0 if a key interrupted */
+/* **************************************************** */
+
+#endif
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "common.h"
+#include "editor.h"
+
+/* **************************************************** */
+/* Byte i of the line, skipping over the gap            */
+/* **************************************************** */
+static char At(Editor *E, size_t i)
+{
+    return (i < E->gapStart) ? E->text.buf[i] : E->text.buf[i + E->gapEnd - E->gapStart];
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Moves the gap so it starts at pos. Only the bytes    */
+/* between the old and new cursor are copied.           */
+/* **************************************************** */
+static void MoveGap(Editor *E, size_t pos)
+{
+    size_t n;
+    char *buf = E->text.buf;
+
+    if (pos < E->gapStart) {                            /* Bytes before pos go after the gap        */
+        n = E->gapStart - pos;
+        memmove(buf + E->gapEnd - n, buf + pos, n);
+        E->gapStart -= n;
+        E->gapEnd -= n;
+    } else if (pos > E->gapStart) {                     /* Bytes after the gap come before it       */
+        n = pos - E->gapStart;
+        memmove(buf + E->gapStart, buf + E->gapEnd, n);
+        E->gapStart += n;
+        E->gapEnd += n;
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Makes sure the gap holds need bytes. The text after  */
+/* the gap moves to the end of the bigger buffer.       */
+/* Returns 0 if the line would be past ArgMax().        */
+/* **************************************************** */
+static char GrowGap(Editor *E, size_t need)
+{
+    size_t tail = E->text.size - E->gapEnd;
+
+    if (E->gapEnd - E->gapStart >= need) return 1;
+    if (!GrowLine(&E->text, E->gapStart + tail + need)) return 0;
+    memmove(E->text.buf + E->text.size - tail, E->text.buf + E->gapEnd, tail);
+    E->gapEnd = E->text.size - tail;
+    return 1;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Columns of the terminal, 0 if STDOUT isn't one, in   */
+/* which case the line is taken to never wrap           */
+/* **************************************************** */
+size_t TermWidth(void)
+{
+    struct winsize ws;
+    if ((ioctl(SO, TIOCGWINSZ, &ws) == -1) || (ws.ws_col == 0)) return 0;
+    return ws.ws_col;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Emits count copies of a character                    */
+/* **************************************************** */
+static void Repeat(char c, size_t count)
+{
+    char run[SMALL_MOVE];
+
+    memset(run, c, SMALL_MOVE);
+    while (count > SMALL_MOVE) {
+        Emit(SO, run, SMALL_MOVE);
+        count -= SMALL_MOVE;
+    }
+    Emit(SO, run, count);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Emits ESC [ n code, a relative cursor move           */
+/* **************************************************** */
+static void Step(size_t n, char code)
+{
+    char seq[32];
+    if (n) Emit(SO, seq, snprintf(seq, sizeof(seq), "\033[%zu%c", n, code));
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Moves the terminal's cursor between two offsets of   */
+/* the shown line. Offsets are turned into rows and     */
+/* columns past the prompt, so wrapped lines work.      */
+/* Short moves left use '\b', the rest ESC [ n A/B/C/D. */
+/* **************************************************** */
+static void MoveTo(Editor *E, size_t to, size_t width)
+{
+    size_t from = E->cursor, prompt = strlen(SHELL_PROMPT);
+    size_t fromRow = 0, toRow = 0, fromCol = from, toCol = to;
+
+    if (width) {
+        fromRow = (prompt + from) / width;
+        fromCol = (prompt + from) % width;
+        toRow = (prompt + to) / width;
+        toCol = (prompt + to) % width;
+    }
+    if (toRow < fromRow) Step(fromRow - toRow, 'A');
+    else Step(toRow - fromRow, 'B');
+
+    if ((toCol < fromCol) && (fromCol - toCol <= SMALL_MOVE))
+        Repeat('\b', fromCol - toCol);
+    else if (toCol < fromCol)
+        Step(fromCol - toCol, 'D');
+    else
+        Step(toCol - fromCol, 'C');
+    E->cursor = to;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Moves the cursor offset past len bytes just printed. */
+/* A terminal that just filled the last column waits to */
+/* wrap, so the wrap is forced to keep the cursor where */
+/* MoveTo() thinks it is.                               */
+/* **************************************************** */
+static void Advance(Editor *E, size_t len, size_t width)
+{
+    E->cursor += len;
+    if (width && len && ((strlen(SHELL_PROMPT) + E->cursor) % width == 0))
+        Emit(SO, "\r\n", 2);
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Brings the terminal up to date with the line. Only   */
+/* the bytes between the first and last difference are */
+/* sent, after the common prefix (and the common tail,  */
+/* when the length didn't change). Typing at the end    */
+/* sends one byte, and moving the cursor only sends     */
+/* the move. A shorter line has the rest blanked.       */
+/* **************************************************** */
+void RefreshLine(Editor *E)
+{
+    size_t n = LineLength(E), m = E->shownLen, width = TermWidth();
+    size_t first = 0, last = n, i;
+    char *shown;
+
+    if (!GrowLine(&E->shown, n + 1)) return;            /* Can't happen, text is no longer          */
+    shown = E->shown.buf;
+
+    while ((first < n) && (first < m) && (At(E, first) == shown[first]))
+        first++;
+    if (n == m)                                         /* Same length, the tail may be unchanged   */
+        while ((last > first) && (At(E, last - 1) == shown[last - 1]))
+            last--;
+
+    for (i = first; i < last; i++)                      /* Shown copy follows the line              */
+        shown[i] = At(E, i);
+    if (first < last) {
+        MoveTo(E, first, width);
+        Emit(SO, shown + first, last - first);
+        Advance(E, last - first, width);
+    }
+    if (m > n) {                                        /* Blank what the old line had past the end */
+        MoveTo(E, n, width);
+        if (m - n <= SMALL_MOVE) {
+            Repeat(' ', m - n);
+            Advance(E, m - n, width);
+        } else
+            Emit(SO, "\033[J", 3);                      /* Clears wrapped rows below too            */
+    }
+    E->shownLen = n;
+    MoveTo(E, E->gapStart, width);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Draws the whole line. The terminal shows a fresh     */
+/* prompt and nothing after it.                         */
+/* **************************************************** */
+void RedrawLine(Editor *E)
+{
+    E->shownLen = 0;
+    E->cursor = 0;
+    RefreshLine(E);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Puts the terminal's cursor after the shown line, so  */
+/* output that follows doesn't land on top of it        */
+/* **************************************************** */
+void LeaveLine(Editor *E)
+{
+    MoveTo(E, E->shownLen, TermWidth());
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Start an empty line, right after the prompt          */
+/* **************************************************** */
+void InitEditor(Editor *E)
+{
+    InitLine(&E->text);
+    InitLine(&E->shown);
+    ResetEditor(E);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Empties the line, the terminal shows a new prompt    */
+/* **************************************************** */
+void ResetEditor(Editor *E)
+{
+    E->gapStart = 0;
+    E->gapEnd = E->text.size;
+    E->shownLen = 0;
+    E->cursor = 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Bytes on the line                                    */
+/* **************************************************** */
+size_t LineLength(Editor *E)
+{
+    return E->text.size - (E->gapEnd - E->gapStart);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the line '\0' terminated. The gap is moved   */
+/* to the end, which moves the cursor there too.        */
+/* **************************************************** */
+char *LineText(Editor *E)
+{
+    MoveGap(E, LineLength(E));
+    E->text.buf[E->gapStart] = '\0';                    /* The gap always has a byte to spare       */
+    return E->text.buf;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Inserts a key at the cursor. Returns 0 if the line   */
+/* is already as long as a command can be.              */
+/* **************************************************** */
+char InsertKey(Editor *E, char key)
+{
+    if (!GrowGap(E, 2)) return 0;                       /* Room for the key and LineText()'s '\0'   */
+    E->text.buf[E->gapStart++] = key;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Deletes the byte before the cursor                   */
+/* **************************************************** */
+char DeleteBack(Editor *E)
+{
+    if (!E->gapStart) return 0;
+    E->gapStart--;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Deletes the byte under the cursor                    */
+/* **************************************************** */
+char DeleteForward(Editor *E)
+{
+    if (E->gapEnd == E->text.size) return 0;
+    E->gapEnd++;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Puts the cursor at pos, clamped to the line          */
+/* **************************************************** */
+char MoveCursor(Editor *E, size_t pos)
+{
+    if (pos > LineLength(E)) pos = LineLength(E);
+    if (pos == E->gapStart) return 0;
+    MoveGap(E, pos);
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Start of the word before the cursor                  */
+/* **************************************************** */
+size_t WordLeft(Editor *E)
+{
+    size_t i = E->gapStart;
+
+    while (i && Check4Space(At(E, i - 1))) i--;         /* Blanks first, then the word              */
+    while (i && !Check4Space(At(E, i - 1))) i--;
+    return i;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* End of the word after the cursor                     */
+/* **************************************************** */
+size_t WordRight(Editor *E)
+{
+    size_t i = E->gapStart, n = LineLength(E);
+
+    while ((i < n) && Check4Space(At(E, i))) i++;
+    while ((i < n) && !Check4Space(At(E, i))) i++;
+    return i;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Deletes everything between the cursor and pos. It    */
+/* only widens the gap, nothing is copied.              */
+/* **************************************************** */
+char KillTo(Editor *E, size_t pos)
+{
+    if (pos > LineLength(E)) pos = LineLength(E);
+    if (pos == E->gapStart) return 0;
+    if (pos < E->gapStart) E->gapStart = pos;
+    else E->gapEnd += pos - E->gapStart;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Replaces the line, e.g. with a history entry, and    */
+/* puts the cursor at its end. Returns 0 if too long.   */
+/* **************************************************** */
+char SetLine(Editor *E, const char *line, size_t len)
+{
+    if (!GrowLine(&E->text, len + 1)) return 0;
+    memcpy(E->text.buf, line, len);
+    E->gapStart = len;
+    E->gapEnd = E->text.size;
+    return 1;
+}
+/* **************************************************** */
@@ -0,0 +1,40 @@
+#ifndef _EDITOR_H
+#define _EDITOR_H
+
+/* **************************************************** */
+/*                  Editor Structures                   */
+/* **************************************************** */
+#define SMALL_MOVE 4                                    /* Moves this short use '\b's or spaces, not escapes */
+
+typedef struct Editor {                                 /* Command line being typed, as a gap buffer        */
+    LineBuf text;                                       /* [0, gapStart) and [gapEnd, size) hold the line   */
+    size_t gapStart;                                    /* Cursor position, start of the gap                */
+    size_t gapEnd;                                      /* First byte after the gap                         */
+    LineBuf shown;                                      /* The line as the terminal shows it now            */
+    size_t shownLen;                                    /* Length of the shown line                         */
+    size_t cursor;                                      /* Where the terminal's cursor is in the shown line */
+} Editor;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Editor Functions                   */
+/* **************************************************** */
+void InitEditor(Editor *E);                             /* Start an empty line, right after the prompt      */
+void ResetEditor(Editor *E);                            /* Empty the line, a new prompt was just printed    */
+size_t LineLength(Editor *E);                           /* Bytes on the line                                */
+char *LineText(Editor *E);                              /* NUL terminated line, moves the cursor to the end */
+char InsertKey(Editor *E, char key);                    /* Insert at the cursor, 0 if the line is too long  */
+char DeleteBack(Editor *E);                             /* Backspace, 0 at the start of the line            */
+char DeleteForward(Editor *E);                          /* Delete, 0 at the end of the line                 */
+char MoveCursor(Editor *E, size_t pos);                 /* Put the cursor at pos, 0 if already there        */
+size_t WordLeft(Editor *E);                             /* Start of the word before the cursor              */
+size_t WordRight(Editor *E);                            /* End of the word after the cursor                 */
+char KillTo(Editor *E, size_t pos);                     /* Delete from the cursor to pos, 0 if nothing      */
+char SetLine(Editor *E, const char *line, size_t len);  /* Replace the line, cursor at the end              */
+void RefreshLine(Editor *E);                            /* Send the terminal only what changed              */
+void RedrawLine(Editor *E);                             /* Draw the whole line after a fresh prompt         */
+void LeaveLine(Editor *E);                              /* Cursor past the line, before printing below it   */
+size_t TermWidth(void);                                 /* Columns of the terminal, 0 if STDOUT isn't one   */
+/* **************************************************** */
+
+#endif
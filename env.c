@@ -0,0 +1,256 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "common.h"                                     /* ThrowError()                             */
+#include "env.h"                                        /* Variable structures and prototypes       */
+/* **************************************************** */
+extern char **environ;                                  /* What getenv() and exec read              */
+static VarTable vars;                                   /* Lives as long as the shell               */
+/* **************************************************** */
+/* **************************************************** */
+/* FNV-1a hash of the len bytes of a variable name      */
+/* **************************************************** */
+static unsigned int HashName(const char *name, size_t len)
+{
+    unsigned int h = 2166136261u;
+    while (len--) h = (h ^ (unsigned char) *name++) * 16777619u;
+    return h & (VAR_BUCKETS - 1);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the length of the variable name p starts     */
+/* with, letters, digits and '_' not led by a digit, or */
+/* 0 if p doesn't start with one                        */
+/* **************************************************** */
+size_t VarName(const char *p)
+{
+    size_t len = 0;
+    if (!isalpha((unsigned char) *p) && (*p != '_')) return 0;
+    while (isalnum((unsigned char) p[len]) || (p[len] == '_')) len++;
+    return len;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the link pointing at the len byte name, or   */
+/* the NULL link ending its bucket if it isn't set, so  */
+/* it can be added or unlinked in place                 */
+/* **************************************************** */
+static Var **FindVar(const char *name, size_t len)
+{
+    Var **link = &vars.table[HashName(name, len)];
+    for (; *link != NULL; link = &(*link)->next)        /* Only the names sharing this bucket       */
+        if (((*link)->nameLen == len) && !memcmp((*link)->pair, name, len)) break;
+    return link;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the value of the len byte name, or NULL if   */
+/* it isn't set                                         */
+/* **************************************************** */
+const char *GetVar(const char *name, size_t len)
+{
+    Var *v = *FindVar(name, len);
+    return (v == NULL) ? NULL : v->pair + v->nameLen + 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Gives the len byte name a value, and exports it if   */
+/* export is 1. A variable that was exported stays so.  */
+/* The old pair is freed while environ may still point  */
+/* at it, so Environment() must run before the next     */
+/* getenv() or launch.                                  */
+/* **************************************************** */
+static void SetVar(const char *name, size_t len, const char *value, char export)
+{
+    Var **link = FindVar(name, len), *v = *link;
+    size_t n = strlen(value);
+
+    if (v == NULL) {                                    /* New name, end of its bucket              */
+        v = (Var *) malloc(sizeof(Var));
+        v->pair = NULL;
+        v->nameLen = len;
+        v->exported = 0;
+        v->next = NULL;
+        *link = v;
+        vars.count++;
+    }
+    free(v->pair);
+    v->pair = (char *) malloc(len + n + 2);
+    memcpy(v->pair, name, len);
+    v->pair[len] = '=';
+    memcpy(v->pair + len + 1, value, n + 1);            /* Value and its NUL                        */
+
+    if (export && !v->exported) {
+        v->exported = 1;
+        vars.nExported++;
+    }
+    if (v->exported) vars.dirty = 1;                    /* Programs must see the new value          */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Imports the environment main() was given. Every      */
+/* "NAME=value" with a valid name becomes an exported   */
+/* variable, and the first envp is built from them.     */
+/* **************************************************** */
+void InitVars(char **envp)
+{
+    size_t len;
+    for (; *envp != NULL; envp++)
+        if ((len = VarName(*envp)) && ((*envp)[len] == '='))
+            SetVar(*envp, len, *envp + len + 1, 1);
+    vars.dirty = 1;                                     /* Even an empty one is ours from now on    */
+    Environment();
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the NULL terminated "NAME=value" pairs of    */
+/* the exported variables, for exec. The array is only  */
+/* rebuilt when a variable was exported, changed or     */
+/* unset since the last call, so launches reuse it. The */
+/* pairs are the variables' own strings, nothing is     */
+/* copied. environ is pointed at it too, so getenv()    */
+/* sees the shell's variables.                          */
+/* **************************************************** */
+char **Environment(void)
+{
+    Var *v;
+    int i, n = 0;
+
+    if (!vars.dirty) return vars.envp;                  /* Nothing exported changed                 */
+    free(vars.envp);
+    vars.envp = (char **) malloc((vars.nExported + 1) * sizeof(char *));
+    for (i = 0; i < VAR_BUCKETS; i++)
+        for (v = vars.table[i]; v != NULL; v = v->next)
+            if (v->exported) vars.envp[n++] = v->pair;
+    vars.envp[n] = NULL;
+    environ = vars.envp;
+    vars.dirty = 0;
+    return vars.envp;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the environment of a stage led by n          */
+/* "NAME=value" words, in A: the shell's pairs, less    */
+/* those the stage sets, then the stage's own. A name   */
+/* is looked up in the table to find the pair it        */
+/* replaces, which is then skipped by its address, so   */
+/* no name is compared against the whole environment.   */
+/* Only the pointers are copied. When a name is set     */
+/* twice the last one wins, as in sh.                   */
+/* **************************************************** */
+char **StageEnv(char **assign, int n, Arena *A)
+{
+    char **e, **envp, **skip = (char **) ArenaAlloc(A, n * sizeof(char *));
+    Var *v;
+    int i, j, k = 0;
+
+    for (i = 0; i < n; i++) {                           /* The shell's pair each one replaces       */
+        v = *FindVar(assign[i], VarName(assign[i]));
+        skip[i] = ((v != NULL) && v->exported) ? v->pair : NULL;
+    }
+    envp = (char **) ArenaAlloc(A, (vars.nExported + n + 1) * sizeof(char *));
+    for (e = Environment(); *e != NULL; e++) {
+        for (i = 0; (i < n) && (*e != skip[i]); i++);
+        if (i == n) envp[k++] = *e;
+    }
+    for (i = 0; i < n; i++) {
+        for (j = i + 1; j < n; j++)                     /* Set again later on the stage             */
+            if (!strncmp(assign[j], assign[i], VarName(assign[i]) + 1)) break;
+        if (j == n) envp[k++] = assign[i];
+    }
+    envp[k] = NULL;
+    return envp;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Sets the variables of a line that is only "NAME=     */
+/* value" words. They are shell variables, only those   */
+/* already exported reach programs.                     */
+/* **************************************************** */
+char AssignVars(char **assign, int n)
+{
+    int i;
+    size_t len;
+    for (i = 0; i < n; i++) {                           /* ParseCommand() checked the names         */
+        len = VarName(assign[i]);
+        SetVar(assign[i], len, assign[i] + len + 1, 0);
+    }
+    Environment();
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Exports each NAME, setting it first for NAME=value.  */
+/* A NAME that isn't set is exported empty.             */
+/* Returns 0 if good, 1 if a name was bad               */
+/* **************************************************** */
+char ExportVars(char *argv[])
+{
+    Var *v;
+    size_t len;
+    char failed = 0;
+
+    for (argv++; *argv != NULL; argv++) {
+        len = VarName(*argv);
+        if (!len || (((*argv)[len] != '=') && ((*argv)[len] != '\0'))) {
+            ThrowError("Error: bad variable name");
+            failed = 1;
+        }
+        else if ((*argv)[len] == '=') SetVar(*argv, len, *argv + len + 1, 1);
+        else if ((v = *FindVar(*argv, len)) == NULL) SetVar(*argv, len, "", 1);
+        else if (!v->exported) {                        /* Keeps its value                          */
+            v->exported = 1;
+            vars.nExported++;
+            vars.dirty = 1;
+        }
+    }
+    Environment();
+    return failed;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Removes each NAME, from the environment too          */
+/* Returns 0 if good, 1 if a name was bad               */
+/* **************************************************** */
+char UnsetVars(char *argv[])
+{
+    Var **link, *v;
+    size_t len;
+    char failed = 0;
+
+    for (argv++; *argv != NULL; argv++) {
+        len = VarName(*argv);
+        if (!len || ((*argv)[len] != '\0')) {
+            ThrowError("Error: bad variable name");
+            failed = 1;
+            continue;
+        }
+        if ((v = *(link = FindVar(*argv, len))) == NULL) continue; /* Not set, nothing to do   */
+        *link = v->next;                                /* Unlink it                                */
+        if (v->exported) {
+            vars.nExported--;
+            vars.dirty = 1;
+        }
+        free(v->pair);
+        free(v);
+        vars.count--;
+    }
+    Environment();
+    return failed;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Print each exported variable as 'export NAME=value'  */
+/* **************************************************** */
+void ListVars(int fd)
+{
+    char **e;
+    for (e = Environment(); (e != NULL) && (*e != NULL); e++)
+        dprintf(fd, "export %s\n", *e);
+}
+/* **************************************************** */
@@ -0,0 +1,42 @@
+#ifndef _ENV_H
+#define _ENV_H
+
+#include <stddef.h>                                     /* size_t                                           */
+#include "arena.h"                                      /* Per-command environments live in its arena       */
+
+/* **************************************************** */
+/*                   Variable Structures                */
+/* **************************************************** */
+#define VAR_BUCKETS 256                                 /* Size of the variable hash table, a power of 2    */
+
+typedef struct Var {                                    /* One shell variable                               */
+    char *pair;                                         /* "NAME=value", handed to exec as it is            */
+    size_t nameLen;                                     /* Bytes before the '=', the value follows it       */
+    char exported;                                      /* 1 if programs get it in their environment        */
+    struct Var *next;                                   /* Next variable in the same bucket                 */
+} Var;
+
+typedef struct VarTable {                               /* Every variable the shell has                     */
+    unsigned int count;                                 /* Number of variables                              */
+    unsigned int nExported;                             /* How many of them are exported                    */
+    char dirty;                                         /* 1 if envp no longer matches the exported ones    */
+    char **envp;                                        /* NULL terminated exported pairs, also environ     */
+    Var *table[VAR_BUCKETS];                            /* Variables hashed by name                         */
+} VarTable;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Variable Functions                 */
+/* **************************************************** */
+void InitVars(char **envp);                             /* Imports main()'s envp, every variable exported   */
+size_t VarName(const char *p);                          /* Length of the name p starts with, 0 if none      */
+const char *GetVar(const char *name, size_t len);       /* Value of the len byte name, NULL if it is unset  */
+char **Environment(void);                               /* envp for exec, rebuilt only if exports changed   */
+char **StageEnv(char **assign, int n, Arena *A);        /* Environment() plus a stage's NAME=value words    */
+char AssignVars(char **assign, int n);                  /* A line of only NAME=value words, 0 if good       */
+char ExportVars(char *argv[]);                          /* 'export NAME[=value]...', 0 if good              */
+char UnsetVars(char *argv[]);                           /* 'unset NAME...', 0 if good                       */
+void ListVars(int fd);                                  /* Print the exported variables ('export')          */
+/* **************************************************** */
+
+#endif
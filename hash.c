@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "common.h"                                     /* SearchPath()                             */
+#include "hash.h"                                       /* Path cache structures and prototypes     */
+/* **************************************************** */
+static PathCache cache;                                 /* Lives as long as the shell               */
+/* **************************************************** */
+/* **************************************************** */
+/* FNV-1a hash of a command name                        */
+/* **************************************************** */
+static unsigned int HashName(const char *name)
+{
+    unsigned int h = 2166136261u;
+    while (*name) h = (h ^ (unsigned char) *name++) * 16777619u;
+    return h & (PATH_BUCKETS - 1);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Empties the cache if PATH changed since the entries  */
+/* were found. Returns the current PATH.                */
+/* **************************************************** */
+static const char *CheckPATH(void)
+{
+    const char *PATH = getenv("PATH");
+    if (PATH == NULL) PATH = "/bin:/usr/bin";           /* Same default execvp() uses               */
+    if ((cache.PATH == NULL) || strcmp(cache.PATH, PATH)) {
+        ClearPaths();                                   /* Old entries may now resolve elsewhere    */
+        cache.PATH = strdup(PATH);
+    }
+    return PATH;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the full path a command runs from. The PATH  */
+/* walk is done once per command, later launches reuse  */
+/* the cached path. Names holding a '/' aren't looked   */
+/* up. Returns NULL if prog isn't found anywhere, or is */
+/* only found relative to the current directory, so the */
+/* caller can fall back to execvp() as before.          */
+/* **************************************************** */
+char *LookupPath(const char *prog)
+{
+    const char *PATH = CheckPATH();
+    unsigned int h = HashName(prog);
+    PathEntry *e;
+    char *path;
+
+    if (strchr(prog, '/') != NULL) return NULL;         /* execvp() won't search PATH either        */
+    for (e = cache.table[h]; e != NULL; e = e->next)    /* Only the names sharing this bucket       */
+        if (!strcmp(e->name, prog)) {
+            e->hits++;
+            return e->path;
+        }
+
+    path = SearchPath(prog, PATH);                      /* First use, walk PATH                     */
+    if ((path == NULL) || (*path != '/')) {             /* Relative paths break after 'cd'          */
+        free(path);
+        return NULL;
+    }
+    e = (PathEntry *) malloc(sizeof(PathEntry) + strlen(prog) + 1);
+    e->name = strcpy((char *) (e + 1), prog);           /* Name follows the entry                   */
+    e->path = path;
+    e->hits = 1;
+    e->next = cache.table[h];                           /* Push on the front of the bucket          */
+    cache.table[h] = e;
+    cache.count++;
+    return e->path;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Drop a command whose cached path no longer exists    */
+/* **************************************************** */
+void ForgetPath(const char *prog)
+{
+    PathEntry **link = &cache.table[HashName(prog)];
+    while (*link != NULL) {
+        if (!strcmp((*link)->name, prog)) {
+            PathEntry *e = *link;
+            *link = e->next;                            /* Unlink it                                */
+            free(e->path);
+            free(e);
+            cache.count--;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Empty the cache                                      */
+/* **************************************************** */
+void ClearPaths(void)
+{
+    PathEntry *e, *next;
+    int i;
+    for (i = 0; i < PATH_BUCKETS; i++) {
+        for (e = cache.table[i]; e != NULL; e = next) {
+            next = e->next;
+            free(e->path);
+            free(e);
+        }
+        cache.table[i] = NULL;
+    }
+    cache.count = 0;
+    free(cache.PATH);                                   /* Next lookup saves the PATH again         */
+    cache.PATH = NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Print each cached command with its hit count         */
+/* **************************************************** */
+void ListPaths(int fd)
+{
+    PathEntry *e;
+    int i;
+    CheckPATH();                                        /* Don't list paths PATH no longer gives    */
+    if (cache.count == 0) {
+        dprintf(fd, "hash: hash table empty\n");
+        return;
+    }
+    dprintf(fd, "hits\tcommand\n");
+    for (i = 0; i < PATH_BUCKETS; i++)
+        for (e = cache.table[i]; e != NULL; e = e->next)
+            dprintf(fd, "%4u\t%s\n", e->hits, e->path);
+}
+/* **************************************************** */
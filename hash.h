@@ -0,0 +1,32 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+/* **************************************************** */
+/*                 Path Cache Structures                */
+/* **************************************************** */
+#define PATH_BUCKETS 256                                /* Size of the command hash table, a power of 2     */
+
+typedef struct PathEntry {                              /* One command resolved through PATH                */
+    char *name;                                         /* Command as typed, e.g. "ls"                      */
+    char *path;                                         /* Where it was found, e.g. "/usr/bin/ls"           */
+    unsigned int hits;                                  /* Launches that used this entry                    */
+    struct PathEntry *next;                             /* Next entry in the same bucket                    */
+} PathEntry;
+
+typedef struct PathCache {                              /* Command name -> absolute path                    */
+    char *PATH;                                         /* Copy of the PATH the entries were found in       */
+    unsigned int count;                                 /* Number of cached commands                        */
+    PathEntry *table[PATH_BUCKETS];                     /* Entries hashed by command name                   */
+} PathCache;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                 Path Cache Functions                 */
+/* **************************************************** */
+char *LookupPath(const char *prog);                     /* Cached full path of prog, NULL to let execvp try */
+void ForgetPath(const char *prog);                      /* Drop prog, its cached path stopped working       */
+void ClearPaths(void);                                  /* Empty the cache ('hash -r')                      */
+void ListPaths(int fd);                                 /* Print hits and paths ('hash')                    */
+/* **************************************************** */
+
+#endif
@@ -1,29 +1,180 @@
+#define _GNU_SOURCE                                     /* memmem()                                 */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
+#include "editor.h"
 #include "history.h"
 
+/* **************************************************** */
+/* Bucket of the search index a trigram belongs to      */
+/* **************************************************** */
+static uint32_t TriHash(const char *p)
+{
+    uint32_t x = (unsigned char) p[0] << 16 | (unsigned char) p[1] << 8 | (unsigned char) p[2];
+    return ((x * 2654435761u) >> 16) & (TRI_BUCKETS - 1);
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Returns the text of a command and its length, or     */
+/* NULL if the command was already evicted from the     */
+/* ring. The text is always in one piece.               */
+/* **************************************************** */
+const char *HistoryEntry(History *history, uint64_t seq, size_t *len)
+{
+    HistFile *F = history->file;
+    HistSlot *s = &F->slot[seq & (HIST_SLOTS - 1)];
+
+    if ((seq < F->tail) || (seq >= F->head)) return NULL;
+    if (s->off + HIST_BYTES < F->end) return NULL;      /* Text was overwritten since               */
+    if ((s->off & (HIST_BYTES - 1)) + s->len >= HIST_BYTES) return NULL;
+    *len = s->len;
+    return F->text + (s->off & (HIST_BYTES - 1));
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Makes room for one more command in a posting list.   */
+/* Evicted commands are only dropped from the front     */
+/* when they make up half the list, so each append      */
+/* stays O(1) amortized.                                */
+/* **************************************************** */
+static void GrowPostings(History *history, Postings *P)
+{
+    uint32_t tail = (uint32_t) history->file->tail, drop = 0;
+
+    while ((drop < P->n) && (P->seq[drop] < tail))      /* Evicted commands come first              */
+        drop++;
+    if (drop && (drop * 2 >= P->n)) {
+        memmove(P->seq, P->seq + drop, (P->n - drop) * sizeof(uint32_t));
+        P->n -= drop;
+    }
+    if (P->n < P->size) return;
+    P->size = P->size ? P->size * 2 : 4;
+    P->seq = (uint32_t *) realloc(P->seq, P->size * sizeof(uint32_t));
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Adds a command to the posting list of every trigram  */
+/* in its text                                          */
+/* **************************************************** */
+static void IndexEntry(History *history, uint64_t seq)
+{
+    const char *text;
+    Postings *P;
+    size_t len, i;
+
+    if ((text = HistoryEntry(history, seq, &len)) == NULL) return;
+    for (i = 0; i + 3 <= len; i++) {
+        P = &history->index[TriHash(text + i)];
+        if (P->n && (P->seq[P->n - 1] == (uint32_t) seq))  /* Same trigram twice in this command     */
+            continue;
+        if (P->n == P->size) GrowPostings(history, P);
+        P->seq[P->n++] = (uint32_t) seq;
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Checks if a command still holds the query            */
+/* **************************************************** */
+static char Matches(History *history, uint64_t seq, const char *query, size_t len)
+{
+    size_t n;
+    const char *text = HistoryEntry(history, seq, &n);
+    return (text != NULL) && (memmem(text, n, query, len) != NULL);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Finds the newest command older than *seq that holds  */
+/* the query, and stores its sequence number in *seq.   */
+/* Queries of 3 bytes or more only look at commands     */
+/* sharing the query's rarest trigram, found through    */
+/* the index. Shorter ones scan back from *seq.         */
+/* Commands added since the last search, by this shell  */
+/* or another one, are indexed first.                   */
+/* Returns 1 if found, 0 otherwise.                     */
+/* **************************************************** */
+char SearchHistory(History *history, const char *query, size_t len, uint64_t *seq)
+{
+    HistFile *F = history->file;
+    Postings *P = NULL, *Q;
+    uint64_t s = (*seq > F->head) ? F->head : *seq;
+    size_t i, lo, hi, mid;
+
+    if (history->indexed < F->tail) history->indexed = F->tail;
+    while (history->indexed < F->head)                  /* Catch the index up                       */
+        IndexEntry(history, history->indexed++);
+
+    if (len < 3) {                                      /* Too short to have a trigram              */
+        while (s-- > F->tail)
+            if (Matches(history, s, query, len)) {
+                *seq = s;
+                return 1;
+            }
+        return 0;
+    }
+
+    for (i = 0; i + 3 <= len; i++) {                    /* Pick the shortest posting list           */
+        Q = &history->index[TriHash(query + i)];
+        if ((P == NULL) || (Q->n < P->n)) P = Q;
+    }
+    lo = 0;
+    hi = P->n;
+    while (lo < hi) {                                   /* First command not older than s           */
+        mid = (lo + hi) / 2;
+        if (P->seq[mid] < s) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo-- > 0) {                                  /* Newest candidates first                  */
+        if (P->seq[lo] < F->tail) break;                /* The rest were evicted                    */
+        if (Matches(history, P->seq[lo], query, len)) {
+            *seq = P->seq[lo];
+            return 1;
+        }
+    }
+    return 0;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Copies an entry into the command line. Only what     */
+/* differs from the line shown before is redrawn.       */
+/* **************************************************** */
+static void ShowEntry(History *history, Editor *E)
+{
+    size_t len = 0;
+    const char *text = "";
+
+    if (history->current != history->file->head)        /* Past the newest, the line is left empty  */
+        text = HistoryEntry(history, history->current, &len);
+    if ((text == NULL) || !SetLine(E, text, len)) {     /* Evicted by another shell meanwhile       */
+        ErrorBell();
+        return;
+    }
+    RefreshLine(E);
+}
+/* **************************************************** */
+
 /* **************************************************** */
 /* Displays next history entry in the command line      */
 /* **************************************************** */
-void DisplayNextEntry(History *history, char *cmdLine, int *cursorPos)
+void DisplayNextEntry(History *history, Editor *E)
 {
-    if (history->count == 0 || history->traversed == MAX_HIST_ITEMS || history->traversed == history->count)
+    size_t len;
+
+    if ((history->current <= history->file->tail) ||
+        (HistoryEntry(history, history->current - 1, &len) == NULL))
         ErrorBell();
     else {
-        if (history->traversed == 0)
-            history->current = history->top;
-        else
-            history->current = history->current->next;
-        
-        history->traversed++;
-        ClearCmdLine(cmdLine, cursorPos);
-        write(STDIN_FILENO, history->current->command, strlen(history->current->command));
-        strcpy(cmdLine, history->current->command);
-        *cursorPos = strlen(cmdLine);
-
+        history->current--;
+        ShowEntry(history, E);
     }
 }
 /* **************************************************** */
@@ -31,67 +182,144 @@ void DisplayNextEntry(History *history, char *cmdLine, int *cursorPos)
 /* **************************************************** */
 /* Displays previous history entry in the command line  */
 /* **************************************************** */
-void DisplayPrevEntry(History *history, char *cmdLine, int *cursorPos)
-{	   
-    if (history->count == 0 || history->traversed == 0)
+void DisplayPrevEntry(History *history, Editor *E)
+{
+    if (history->current >= history->file->head)
         ErrorBell();
-        
+
     else {
-        history->traversed--;							
-        history->current = history->current->prev;
-        ClearCmdLine(cmdLine, cursorPos);
-        
-        if (history->traversed != 0) {
-          write(STDIN_FILENO, history->current->command, strlen(history->current->command));
-          strcpy(cmdLine, history->current->command);
-          *cursorPos = strlen(cmdLine);
-        }
+        history->current++;
+        ShowEntry(history, E);
     }
 }
 /* **************************************************** */
 
 /* **************************************************** */
-/* Removes the entry at the bottom of the history list  */
+/* Appends a command to the ring. Commands whose slot   */
+/* or text is about to be reused are evicted by moving  */
+/* the tail, so nothing is walked or freed. Empty and   */
+/* very long commands aren't saved.                     */
 /* **************************************************** */
-void RemoveLastEntry(History *history)
+void AddHistory(History *history, char *cmdLine, int cmdLen)
 {
-    Entry *current = history->top;
-    Entry *previous = history->top;
-    while (current->next != NULL) {
-        previous = current;
-        current = current->next;
+    HistFile *F = history->file;
+    uint64_t off, end;
+    HistSlot *s;
+
+    if ((cmdLen > 0) && (cmdLen <= HIST_LONGEST)) {
+        if (history->fd != -1) flock(history->fd, LOCK_EX); /* Other shells may share the file     */
+
+        off = F->end;
+        if ((off & (HIST_BYTES - 1)) + cmdLen + 1 > HIST_BYTES)
+            off += HIST_BYTES - (off & (HIST_BYTES - 1)); /* Text never wraps, start over at 0      */
+        end = off + cmdLen + 1;
+
+        while ((F->tail < F->head) &&                   /* Evict what this command will overwrite   */
+               ((F->head - F->tail >= HIST_SLOTS) ||
+                (F->slot[F->tail & (HIST_SLOTS - 1)].off + HIST_BYTES < end)))
+            F->tail++;
+
+        memcpy(F->text + (off & (HIST_BYTES - 1)), cmdLine, cmdLen);
+        F->text[(off & (HIST_BYTES - 1)) + cmdLen] = '\0';
+        s = &F->slot[F->head & (HIST_SLOTS - 1)];
+        s->off = off;
+        s->len = cmdLen;
+        F->end = end;
+        F->head++;                                      /* Published last                           */
+
+        if (history->fd != -1) flock(history->fd, LOCK_UN);
     }
-    free(current);
-    previous->next = NULL;
+    history->current = F->head;
 }
 /* **************************************************** */
 
 /* **************************************************** */
-/* Adds a new entry to the history list                 */
+/* Returns 1 if the open file fd is empty or starts     */
+/* with HIST_MAGIC, so it is sshell's to start over if  */
+/* its size or layout is wrong. Anything else, such as  */
+/* another shell's history, is left alone.              */
 /* **************************************************** */
-void AddHistory(History *history, char *cmdLine, int cmdLen)
+static char OwnHistory(int fd, struct stat *st)
 {
-    Entry *h = (Entry*) malloc(sizeof(Entry));
-    h->command  = (char*) malloc(sizeof(char) * (cmdLen+1));
-    strcpy(h->command, cmdLine);
-    
-    if (history->count == 0) {
-        h->next = NULL;
-        h->prev = NULL;
-        history->top = h;											
-    } else {
-        history->top->prev = h;			
-        h->next = history->top;
-        h->prev = NULL;
-        history->top = h;
+    uint32_t magic;
+
+    if (st->st_size == 0) return 1;                     /* Just created                             */
+    return (pread(fd, &magic, sizeof(magic), 0) == sizeof(magic)) && (magic == HIST_MAGIC);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Maps the history file, $SSHELL_HISTORY if set, else  */
+/* ~/.sshell_history. A history file of another size or */
+/* layout is started over. A file that isn't one is     */
+/* never touched: a warning is printed and, as when no  */
+/* file can be mapped, history is kept on the heap for  */
+/* this session only.                                   */
+/* **************************************************** */
+void OpenHistory(History *history)
+{
+    const char *name = getenv("SSHELL_HISTORY"), *home = getenv("HOME");
+    char path[PATH_MAX];
+    char msg[PATH_MAX + 64];
+    struct stat st;
+    HistFile *F = MAP_FAILED;
+    int fd = -1;
+
+    if ((name == NULL) && (home != NULL)) {
+        snprintf(path, sizeof(path), "%s/%s", home, HIST_FILE);
+        name = path;
+    }
+    if ((name != NULL) && *name)                        /* SSHELL_HISTORY="" turns the file off     */
+        fd = open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+    if (fd != -1) {
+        flock(fd, LOCK_EX);
+        if ((fstat(fd, &st) == 0) && OwnHistory(fd, &st)) {
+            if ((st.st_size == sizeof(HistFile)) ||     /* Wrong size, wipe it and start over       */
+                ((ftruncate(fd, 0) == 0) && (ftruncate(fd, sizeof(HistFile)) == 0)))
+                F = (HistFile *) mmap(NULL, sizeof(HistFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        } else {                                        /* e.g. ~/.bash_history, keep it as it is   */
+            snprintf(msg, sizeof(msg), "Warning: %s is not an sshell history file, history won't be saved", name);
+            ThrowError(msg);
+        }
+        if (F == MAP_FAILED) {
+            close(fd);
+            fd = -1;
+        }
     }
-    
-    if (history->count == MAX_HIST_ITEMS)
-        RemoveLastEntry(history);
-    else
-        history->count++;
-    
-    history->current = NULL;
-    history->traversed = 0;
+    if (F == MAP_FAILED)                                /* Untouched pages are never allocated      */
+        F = (HistFile *) calloc(1, sizeof(HistFile));
+
+    if ((F->magic != HIST_MAGIC) || (F->slots != HIST_SLOTS) || (F->bytes != HIST_BYTES) ||
+        (F->tail > F->head) || (F->head - F->tail > HIST_SLOTS)) {
+        F->magic = HIST_MAGIC;                          /* New or damaged, empty it                 */
+        F->slots = HIST_SLOTS;
+        F->bytes = HIST_BYTES;
+        F->head = F->tail = F->end = 0;
+    }
+    if (fd != -1) flock(fd, LOCK_UN);
+
+    history->file = F;
+    history->fd = fd;
+    history->current = F->head;
+    history->indexed = F->tail;                         /* Built by the first search                */
+    history->index = (Postings *) calloc(TRI_BUCKETS, sizeof(Postings));
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Unmaps the history file and frees the search index   */
+/* **************************************************** */
+void CloseHistory(History *history)
+{
+    int i;
+
+    if (history->fd != -1) {
+        munmap(history->file, sizeof(HistFile));
+        close(history->fd);
+    } else
+        free(history->file);
+    for (i = 0; i < TRI_BUCKETS; i++)
+        free(history->index[i].seq);
+    free(history->index);
 }
 /* **************************************************** */
@@ -1,29 +1,62 @@
 #ifndef _HISTORY_H
 #define _HISTORY_H
 
+#include <stdint.h>
+
+#include "editor.h"                                     /* Command line being typed                         */
+
 /* **************************************************** */
 /*                   History Structures                 */
 /* **************************************************** */
-typedef struct Entry {                                  /* History Entry item                               */
-    char *command;                                      /* command to save                                  */
-    struct Entry *next;                                 /* pointer to next entry                            */
-    struct Entry *prev;                                 /* pointer to previous entry                        */
-} Entry;
+#define HIST_FILE    ".sshell_history"                  /* In $HOME, unless $SSHELL_HISTORY names a file    */
+#define HIST_MAGIC   0x31485353                         /* "SSH1", marks a history file of this layout      */
+#define HIST_SLOTS   (1 << 17)                          /* Commands kept, a power of 2                      */
+#define HIST_BYTES   (1 << 23)                          /* Text kept, a power of 2                          */
+#define HIST_LONGEST (HIST_BYTES / 8)                   /* Longer commands are run but not saved            */
+#define TRI_BUCKETS  (1 << 16)                          /* Size of the search index, a power of 2           */
+
+typedef struct HistSlot {                               /* Where one command's text lives                   */
+    uint64_t off;                                       /* Text bytes written before it, so never reused    */
+    uint32_t len;                                       /* Length, not counting the '\0'                    */
+    uint32_t unused;
+} HistSlot;
+
+typedef struct HistFile {                               /* Layout of the memory-mapped history file         */
+    uint32_t magic;                                     /* HIST_MAGIC                                       */
+    uint32_t slots;                                     /* HIST_SLOTS when the file was made                */
+    uint32_t bytes;                                     /* HIST_BYTES when the file was made                */
+    uint32_t unused;
+    uint64_t head;                                      /* Sequence number of the next command              */
+    uint64_t tail;                                      /* Sequence number of the oldest command kept       */
+    uint64_t end;                                       /* Text bytes ever written                          */
+    HistSlot slot[HIST_SLOTS];                          /* Ring of commands, sequence % HIST_SLOTS          */
+    char text[HIST_BYTES];                              /* Ring of '\0' terminated command text             */
+} HistFile;
+
+typedef struct Postings {                               /* Commands holding one trigram, oldest first       */
+    uint32_t *seq;                                      /* Sequence numbers, ascending                      */
+    uint32_t n;                                         /* Number of sequence numbers                       */
+    uint32_t size;                                      /* Capacity of seq                                  */
+} Postings;
 
 typedef struct History {
-    unsigned int count;                                 /* No. items in history linked list                 */
-    unsigned int traversed;                             /* Keeps track of currently traversed entries       */
-    Entry *top;                                         /* Most recent entry                                */
-    Entry *current;                                     /* Entry currently being viewed via. up/down arrows */
+    HistFile *file;                                     /* Mapped file, or heap if it couldn't be mapped    */
+    int fd;                                             /* Open history file, -1 if on the heap             */
+    uint64_t current;                                   /* Entry viewed via. up/down arrows, head if none   */
+    uint64_t indexed;                                   /* Commands before this one are in the index        */
+    Postings *index;                                    /* Trigram -> commands, TRI_BUCKETS lists           */
 } History;
- 
+
 /* **************************************************** */
 /*                   History Functions                  */
 /* **************************************************** */
-void AddHistory(History *history, char *cmdLine, int cmdLen); 	        /* Adds a new entry to the history list                */
-void DisplayNextEntry(History *history, char *cmdLine, int *cursorPos); /* Displays next history entry in the command line     */
-void DisplayPrevEntry(History *history, char *cmdLine, int *cursorPos); /* Displays previous history entry in the command line */
-void RemoveLastEntry(History *history);                                 /* Removes the entry at the bottom of the history list */
+void OpenHistory(History *history);                                     /* Maps the history file, heap if it can't be mapped  */
+void CloseHistory(History *history);                                    /* Unmaps the history file                             */
+void AddHistory(History *history, char *cmdLine, int cmdLen); 	        /* Appends a command, evicting the oldest ones         */
+void DisplayNextEntry(History *history, Editor *E);                     /* Displays next history entry in the command line  */
+void DisplayPrevEntry(History *history, Editor *E);                     /* Displays previous history entry in the command line */
+char SearchHistory(History *history, const char *query, size_t len, uint64_t *seq); /* Newest match older than *seq */
+const char *HistoryEntry(History *history, uint64_t seq, size_t *len);  /* Text of a command, NULL if it was evicted       */
 /* **************************************************** */
 
 #endif
@@ -0,0 +1,381 @@
+#define _GNU_SOURCE                                     /* sigabbrev_np()                           */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "common.h"                                     /* ThrowError(), Emit() and fd names        */
+#include "history.h"                                    /* History structures, needed by sshell.h   */
+#include "sshell.h"                                     /* Wait4Me(), WaitEvent() and Redirect()    */
+#include "jobs.h"                                       /* Job control structures and prototypes    */
+
+/* **************************************************** */
+char jobControl;                                        /* Set by InitJobControl()                  */
+sigset_t jobSignals;                                    /* SIGINT and the stop signals              */
+static pid_t shellPgid;                                 /* Group the terminal goes back to          */
+static struct termios shellModes;                       /* Terminal modes the prompt runs in        */
+/* **************************************************** */
+/* **************************************************** */
+/* Puts the shell in a process group of its own and     */
+/* takes the terminal. Ctrl-Z and terminal access from  */
+/* the background are ignored by the shell from now on, */
+/* and each job gets a group, so Ctrl-C and Ctrl-Z only */
+/* reach the job that has the terminal. Call it after   */
+/* SetNonCanMode(), the modes it set are the ones the   */
+/* shell takes back with the terminal.                  */
+/* Returns 0, and changes nothing, without a terminal.  */
+/* **************************************************** */
+char InitJobControl(void)
+{
+    static const int ignored[] = {SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, 0};
+    struct sigaction ignore;
+    int i;
+
+    if (!isatty(SI)) return 0;                          /* Scripts and pipes run as before          */
+    while (tcgetpgrp(SI) != (shellPgid = getpgrp()))    /* Started in the background, wait for fg   */
+        kill(-shellPgid, SIGTTIN);
+
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&jobSignals);
+    sigaddset(&jobSignals, SIGINT);                     /* Read from the signalfd by the shell      */
+    for (i = 0; ignored[i]; i++) {                      /* Jobs get them back with SETSIGDEF        */
+        sigaction(ignored[i], &ignore, NULL);
+        sigaddset(&jobSignals, ignored[i]);
+    }
+
+    if ((getpid() != shellPgid) && (setpgid(0, 0) == -1)) {
+        perror("setpgid");
+        return 0;
+    }
+    shellPgid = getpid();
+    tcsetpgrp(SI, shellPgid);
+    tcgetattr(SI, &shellModes);
+    return (jobControl = 1);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Hands the terminal to J's process group, or back to  */
+/* the shell when J is NULL. A job may have changed the */
+/* terminal modes, so the shell's own are put back.     */
+/* **************************************************** */
+void SetForeground(Job *J)
+{
+    if (!jobControl) return;
+    if (J != NULL) {
+        if (J->pgid) tcsetpgrp(SI, J->pgid);
+        return;
+    }
+    tcsetpgrp(SI, shellPgid);
+    tcsetattr(SI, TCSADRAIN, &shellModes);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs in a child from fork(), before it execs. Joins  */
+/* the job's process group, or starts it, and takes the */
+/* terminal for a foreground job, like the file actions */
+/* SpawnMe() gives posix_spawn().                       */
+/* **************************************************** */
+void JoinJob(Process *Me)
+{
+    Job *J = Me->job;
+    int sig;
+
+    if (!jobControl) return;
+    setpgid(0, J->pgid);                                /* 0 makes this stage the group leader      */
+    if (!J->isBG && !J->pgid) tcsetpgrp(SI, getpid());
+    for (sig = 1; sig < NSIG; sig++)                    /* Ctrl-C and Ctrl-Z work in the job        */
+        if (sigismember(&jobSignals, sig)) signal(sig, SIG_DFL);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Sends sig to the job's process group, or to each of  */
+/* its running stages without job control.              */
+/* **************************************************** */
+void SignalJob(Job *J, int sig)
+{
+    int i;
+    if (J->pgid) {
+        kill(-J->pgid, sig);
+        return;
+    }
+    for (i = 0; i < J->nPipes + J->nRelays; i++)
+        if (J->stage[i].running && J->stage[i].PID)
+            kill(J->stage[i].PID, sig);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Lets a stopped job run again. Its stages are marked  */
+/* running now, so 'jobs' doesn't have to wait for the  */
+/* reaper to see them continue.                         */
+/* **************************************************** */
+static void ContinueJob(Job *J)
+{
+    int i;
+    for (i = 0; i < J->nPipes + J->nRelays; i++)
+        J->stage[i].stopped = 0;
+    J->nStopped = 0;
+    SignalJob(J, SIGCONT);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Prints "[id] State 'cmd'" for a job                  */
+/* **************************************************** */
+void PrintJob(int fd, Job *J)
+{
+    char head[32];
+    const char *state = !J->nRunning ? "Done" : JobStopped(J) ? "Stopped" : "Running";
+
+    Emit(fd, head, sprintf(head, "[%d] %s '", J->id, state));
+    Emit(fd, J->cmd, strlen(J->cmd));
+    Emit(fd, "'\n", 2);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Finds a job from a spec: %n or n is job n, and %,    */
+/* %% or %+ (or no spec) the newest job still running.  */
+/* With pidOk a plain number is a PID instead, and the  */
+/* job holding that stage is returned.                  */
+/* **************************************************** */
+Job *FindJob(const char *spec, char pidOk)
+{
+    Process *Me;
+    Job *J;
+    char *end;
+    long n;
+
+    if ((spec == NULL) || !strcmp(spec, "%") || !strcmp(spec, "%%") || !strcmp(spec, "%+")) {
+        for (J = processList->tail; J != NULL; J = J->prev)
+            if (J->nRunning) return J;
+        return NULL;
+    }
+    if (*spec == '%') {
+        spec++;
+        pidOk = 0;
+    }
+    n = strtol(spec, &end, 10);
+    if (*end || (end == spec) || (n <= 0)) return NULL;
+    if (pidOk)
+        return ((Me = FindProcess(processList, n)) != NULL) ? Me->job : NULL;
+    for (J = processList->top; J != NULL; J = J->next)
+        if ((J->id == n) && J->nRunning) return J;
+    return NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Error: no such job message, returns 1                */
+/* **************************************************** */
+static int NoSuchJob(void)
+{
+    ThrowError("Error: no such job");
+    return 1;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* jobs [%n...] - Lists the jobs in the table, or the   */
+/* ones named.                                          */
+/* **************************************************** */
+static int ListJobs(Stage *S, int *fd)
+{
+    Job *J;
+    int i, failed = 0;
+
+    if (S->argc == 1) {
+        for (J = processList->top; J != NULL; J = J->next)
+            if (J->printMe) PrintJob(fd[1], J);         /* Not the stages 'parallel' runs           */
+        return 0;
+    }
+    for (i = 1; i < S->argc; i++)
+        if ((J = FindJob(S->argv[i], 0)) != NULL) PrintJob(fd[1], J);
+        else failed = NoSuchJob();
+    return failed;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* fg [%n] - Continues a job with the terminal, and     */
+/* waits for it like any foreground command. Returns    */
+/* its status, or 148 if it is stopped again.           */
+/* **************************************************** */
+static int Foreground(Stage *S, int *fd)
+{
+    Job *J = FindJob(S->argv[1], 0);
+
+    if (J == NULL) return NoSuchJob();
+    Emit(fd[1], J->cmd, strlen(J->cmd));                /* Which job the terminal now belongs to    */
+    Emit(fd[1], "\n", 1);
+    FlushOut();
+    J->isBG = 0;
+    SetForeground(J);
+    ContinueJob(J);
+    return Wait4Me(J);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* bg [%n] - Continues a stopped job in the background  */
+/* **************************************************** */
+static int Background(Stage *S, int *fd)
+{
+    Job *J = FindJob(S->argv[1], 0);
+
+    if (J == NULL) return NoSuchJob();
+    J->isBG = 1;
+    ContinueJob(J);
+    PrintJob(fd[1], J);
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Sleeps until job id ends or stops, or every job when */
+/* id is 0. Jobs that end meanwhile are reported.       */
+/* Returns the job's status, 130 on Ctrl-C.             */
+/* **************************************************** */
+static int WaitFor(int id)
+{
+    Job *J;
+    int status = 0;
+    char busy;
+
+    while (1) {
+        busy = 0;
+        for (J = processList->top; J != NULL; J = J->next) {
+            if (id && (J->id != id)) continue;
+            if (!J->nRunning) status = J->stage[J->nPipes - 1].status; /* Freed once it's reported */
+            else if (!JobStopped(J)) busy = 1;
+        }
+        CheckCompletedProcesses(processList);
+        if (!busy) return id ? status : 0;
+        WaitEvent(FALSE);
+        if (Interrupted()) return 128 + SIGINT;
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* wait [%n|pid...] - Waits for the jobs named, or for  */
+/* every running job. Stopped jobs aren't waited for.   */
+/* **************************************************** */
+static int WaitJobs(Stage *S, int *fd)
+{
+    Job *J;
+    int i, status = 0;
+
+    if (S->argc == 1) return WaitFor(0);
+    for (i = 1; i < S->argc; i++) {
+        if ((J = FindJob(S->argv[i], 1)) == NULL) {
+            NoSuchJob();
+            status = JOB_ERROR;
+        } else if ((status = WaitFor(J->id)) == 128 + SIGINT)
+            break;
+    }
+    return status;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Signal number from "9", "KILL" or "SIGKILL", -1 if   */
+/* there is no such signal                              */
+/* **************************************************** */
+static int SignalNumber(const char *name)
+{
+    char *end;
+    long n = strtol(name, &end, 10);
+    int sig;
+
+    if ((end != name) && !*end) return ((n >= 0) && (n < NSIG)) ? n : -1;
+    if (!strncmp(name, "SIG", 3)) name += 3;
+    for (sig = 1; sig < NSIG; sig++)
+        if ((sigabbrev_np(sig) != NULL) && !strcmp(name, sigabbrev_np(sig))) return sig;
+    return -1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* kill [-sig | -s sig] %n|pid... - Signals whole jobs  */
+/* by their group, or single processes. A stopped job   */
+/* is continued after SIGTERM or SIGHUP, so it can act  */
+/* on them, as bash does. A pid must be a single       */
+/* process: 0 and negative pids, which kill(2) takes as */
+/* whole groups, are refused.                           */
+/* **************************************************** */
+static int KillJobs(Stage *S, int *fd)
+{
+    int sig = SIGTERM, i = 1, failed = 0;
+    char *end;
+    long PID;
+    Job *J;
+
+    if ((S->argc > 1) && !strcmp(S->argv[1], "-s")) {
+        sig = (S->argc > 2) ? SignalNumber(S->argv[2]) : -1;
+        i = 3;
+    } else if ((S->argc > 1) && (S->argv[1][0] == '-')) { /* 'kill -9' alone is a usage error     */
+        sig = SignalNumber(S->argv[1] + 1);
+        i = 2;
+    }
+    if ((sig == -1) || (i >= S->argc)) {
+        ThrowError("Error: usage: kill [-sig | -s sig] %job|pid ...");
+        return 1;
+    }
+
+    for (; i < S->argc; i++) {
+        if (S->argv[i][0] == '%') {
+            if ((J = FindJob(S->argv[i], 0)) == NULL) {
+                failed = NoSuchJob();
+                continue;
+            }
+            SignalJob(J, sig);
+            if (((sig == SIGTERM) || (sig == SIGHUP)) && JobStopped(J))
+                ContinueJob(J);
+        } else {
+            PID = strtol(S->argv[i], &end, 10);
+            if (*end || (end == S->argv[i]) || (PID <= 0) || (kill(PID, sig) == -1)) {
+                ThrowError("Error: no such process");
+                failed = 1;
+            }
+        }
+    }
+    return failed;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Dispatch Table                     */
+/* **************************************************** */
+static const JobBuiltin jobBuiltins[] = {
+    {"jobs", ListJobs},
+    {"fg",   Foreground},
+    {"bg",   Background},
+    {"wait", WaitJobs},
+    {"kill", KillJobs},
+    {NULL,   NULL}
+};
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the table entry for name, NULL if not found  */
+/* **************************************************** */
+const JobBuiltin *FindJobBuiltin(const char *name)
+{
+    const JobBuiltin *B;
+    for (B = jobBuiltins; B->name != NULL; B++)
+        if (!strcmp(B->name, name)) return B;
+    return NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a job control builtin on the fds Redirect()     */
+/* opens for its stage, and reports it with             */
+/* CompleteCmd(). Only the first stage is looked at, as */
+/* with cd and pwd.                                     */
+/* **************************************************** */
+void RunJobBuiltin(Command *C, char *cmd)
+{
+    Stage *S = &C->stage[0];
+    int fd[2], status;
+
+    if (Redirect(S, fd)) return;                        /* Reported like a failed external launch   */
+    status = FindJobBuiltin(S->argv[0])->run(S, fd);
+    FlushOut();                                         /* Before its output file is closed         */
+    if (fd[0] != SI) close(fd[0]);
+    if (fd[1] != SO) close(fd[1]);
+    CompleteCmd(cmd, status);
+}
+/* **************************************************** */
@@ -0,0 +1,42 @@
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <signal.h>
+#include "parse.h"                                      /* Builtins get the parsed stage                    */
+#include "process.h"                                    /* Jobs are managed in the job table                */
+
+/* **************************************************** */
+/*                  Job Control Structures              */
+/* **************************************************** */
+#define JOB_STOPPED 148                                 /* Status of a job stopped by Ctrl-Z, 128 + SIGTSTP */
+#define JOB_ERROR   127                                 /* No such job, as bash has it                      */
+
+typedef int (*JobFn)(Stage *S, int *fd);                /* Exit status of a job control builtin             */
+
+typedef struct JobBuiltin {                             /* Builtin that manages the job table               */
+    const char *name;                                   /* Command name, as typed                           */
+    JobFn run;                                          /* Runs it on the stage's redirect fds              */
+} JobBuiltin;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                  Global Structures                   */
+/* **************************************************** */
+extern char jobControl;                                 /* 1 when jobs get process groups & the terminal    */
+extern sigset_t jobSignals;                             /* Ignored by the shell, default again in jobs      */
+/* **************************************************** */
+
+/* **************************************************** */
+/*                 Job Control Functions                */
+/* **************************************************** */
+char InitJobControl(void);                              /* Own group & the terminal, 1 if job control is on */
+void SetForeground(Job *J);                             /* Hands the terminal to J, NULL takes it back      */
+void JoinJob(Process *Me);                              /* In a forked child, joins the job's process group */
+void SignalJob(Job *J, int sig);                        /* Sends sig to every running stage of J            */
+void PrintJob(int fd, Job *J);                          /* "[id] State 'cmd'" line, as 'jobs' lists it      */
+Job *FindJob(const char *spec, char pidOk);             /* %n, %+ or a PID, NULL if there is no such job    */
+const JobBuiltin *FindJobBuiltin(const char *name);     /* jobs, fg, bg, wait or kill, NULL otherwise       */
+void RunJobBuiltin(Command *C, char *cmd);              /* Runs one and prints its '+ completed' message    */
+/* **************************************************** */
+
+#endif
@@ -0,0 +1,489 @@
+#define _GNU_SOURCE                                     /* memfd_create()                           */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+#include "common.h"                                     /* ThrowError() and fd names                */
+#include "history.h"                                    /* History structures, needed by sshell.h   */
+#include "sshell.h"                                     /* LaunchMe(), WaitEvent() and the job table */
+#include "parallel.h"                                   /* Parallel structures and prototypes       */
+#include "jobs.h"                                       /* SignalJob()                              */
+
+extern char **environ;                                  /* Counted against ARG_MAX                  */
+
+/* **************************************************** */
+/* Number of "{}" in a word                             */
+/* **************************************************** */
+static int Holes(const char *word)
+{
+    int n = 0;
+    while ((word = strstr(word, "{}")) != NULL) {
+        n++;
+        word += 2;
+    }
+    return n;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Reads a count after -j or -n, from the same word or  */
+/* the next one. Returns 0 if it isn't a number > 0.    */
+/* **************************************************** */
+static long Count(char *argv[], int *i)
+{
+    char *p = argv[*i] + 2, *end;
+    long n;
+
+    if (!*p && ((p = argv[++*i]) == NULL)) return 0;
+    n = strtol(p, &end, 10);
+    return (*end || (n <= 0)) ? 0 : n;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Splits 'parallel [-j N] [-n N] [-X] cmd ... [::: a   */
+/* b ...]' into options, the command and its arguments. */
+/* Returns 1 if the line is wrong, 2 if -j is too big,  */
+/* which is reported here.                              */
+/* **************************************************** */
+static char ParseOptions(Parallel *P, Stage *S)
+{
+    char **argv = S->argv;
+    long n;
+    int i, j;
+
+    P->jobs = sysconf(_SC_NPROCESSORS_ONLN);            /* One job per core by default              */
+    if (P->jobs < 1) P->jobs = 1;
+    P->maxArgs = 1;
+    for (i = 1; (argv[i] != NULL) && (argv[i][0] == '-'); i++) {
+        if (!strcmp(argv[i], "--")) {
+            i++;
+            break;
+        } else if (!strncmp(argv[i], "-j", 2)) {
+            if (!(n = Count(argv, &i))) return 1;
+            if (n > PAR_MAX_JOBS) {                     /* A slot and a memfd each                  */
+                ThrowError("Error: parallel runs at most " PAR_MAX_TEXT " jobs at once");
+                return 2;
+            }
+            P->jobs = n;
+        } else if (!strncmp(argv[i], "-n", 2)) {
+            if (!(n = Count(argv, &i))) return 1;
+            P->maxArgs = n;
+        } else if (!strcmp(argv[i], "-X"))
+            P->maxArgs = (size_t) -1;                   /* As many as ARG_MAX takes                 */
+        else
+            return 1;
+    }
+
+    P->tmpl = argv + i;
+    for (j = i; (argv[j] != NULL) && strcmp(argv[j], ":::"); j++)
+        P->holes += (Holes(argv[j]) != 0);
+    P->nTmpl = j - i;
+    if (argv[j] != NULL) {                              /* Arguments are on the line                */
+        argv[j] = NULL;                                 /* Ends the command                         */
+        P->list = argv + j + 1;
+    }
+    return !P->nTmpl;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Bytes of ARG_MAX a command may spend on arguments,   */
+/* after the environment and the command itself         */
+/* **************************************************** */
+static size_t Room(Parallel *P)
+{
+    size_t used = PAR_MARGIN, max = ArgMax();
+    char **e;
+    int i;
+
+    for (e = environ; *e != NULL; e++)
+        used += strlen(*e) + 1 + sizeof(char *);
+    for (i = 0; i < P->nTmpl; i++)
+        if (!Holes(P->tmpl[i])) used += strlen(P->tmpl[i]) + 1 + sizeof(char *);
+    return (used < max) ? max - used : 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Bytes one argument adds to a command, once for each  */
+/* word it fills in                                     */
+/* **************************************************** */
+static size_t ArgCost(Parallel *P, const char *arg)
+{
+    size_t len = strlen(arg), cost = 0;
+    int i, n;
+
+    if (!P->holes) return len + 1 + sizeof(char *);
+    for (i = 0; i < P->nTmpl; i++)
+        if ((n = Holes(P->tmpl[i])))
+            cost += strlen(P->tmpl[i]) + n * len - 2 * n + 1 + sizeof(char *);
+    return cost;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Copies the size bytes of a job's memfd to the output */
+/* with sendfile(), in the kernel. An output sendfile() */
+/* can't write to, such as a file opened with '>>',     */
+/* gets pread() and write() instead.                    */
+/* Returns 0 if good, 1 if the output failed            */
+/* **************************************************** */
+static char CopyOut(Parallel *P, int in, off_t size)
+{
+    static char buf[PAR_COPY];
+    off_t off = 0;
+    ssize_t got, put, done;
+    char copy = 0;
+
+    while (off < size) {
+        if (!copy) {
+            if ((put = sendfile(P->outFd, in, &off, size - off)) > 0) continue;
+            if ((put == -1) && (errno == EINTR)) continue;
+            if ((put == -1) && ((errno == EINVAL) || (errno == ENOSYS))) copy = 1; /* e.g. O_APPEND */
+            else return 1;                              /* EPIPE, ENOSPC, ...                       */
+            continue;
+        }
+        if ((got = pread(in, buf, ((size - off) < PAR_COPY) ? size - off : PAR_COPY, off)) <= 0) {
+            if ((got == -1) && (errno == EINTR)) continue;
+            return 1;
+        }
+        for (done = 0; done < got; done += put)
+            if ((put = write(P->outFd, buf + done, got - done)) <= 0) {
+                if ((put == -1) && (errno == EINTR)) put = 0;
+                else return 1;
+            }
+        off += got;
+    }
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Takes a finished job out of its slot, counts its     */
+/* exit code, and copies its output in one piece, so    */
+/* jobs' output never interleaves. A job whose output   */
+/* couldn't be written counts as failed, with exit code */
+/* 1 if it had none. The error is printed once, and the */
+/* output of the jobs after it is dropped.              */
+/* **************************************************** */
+static void Collect(Parallel *P, ParSlot *S)
+{
+    int status = S->job->stage[0].status & 255;
+    off_t size;
+
+    S->job = NULL;
+    if (S->out != -1) {
+        FlushOut();                                     /* The shell's own output goes first        */
+        size = lseek(S->out, 0, SEEK_END);
+        if ((size > 0) && (P->lost || CopyOut(P, S->out, size))) {
+            if (!P->lost) perror("parallel");           /* Output went away, or the disk is full    */
+            P->lost = 1;
+            if (!status) status = 1;
+        }
+        close(S->out);
+    }
+    P->exits[status]++;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* CTRL+C: nothing more is launched, and it is passed   */
+/* on to the running jobs and the stages feeding them.  */
+/* **************************************************** */
+static void CheckInterrupt(Parallel *P)
+{
+    int i;
+
+    if (!Interrupted() || P->stop) return;
+    P->stop = 1;
+    for (i = 0; i < P->jobs; i++)
+        if (P->slot[i].job != NULL) SignalJob(P->slot[i].job, SIGINT);
+    if (P->feed != NULL) SignalJob(P->feed, SIGINT);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Collects the jobs that finished, then lets the table */
+/* drop them and report any other jobs                  */
+/* **************************************************** */
+static void Reap(Parallel *P)
+{
+    int i;
+
+    for (i = 0; i < P->jobs; i++)                       /* Output of finished jobs first            */
+        if ((P->slot[i].job != NULL) && !P->slot[i].job->nRunning)
+            Collect(P, &P->slot[i]);
+    if ((P->feed != NULL) && !P->feed->nRunning) P->feed = NULL; /* Removed from the table next   */
+    CheckCompletedProcesses(processList);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the next argument without using it up, NULL  */
+/* once there are none or CTRL+C was typed. Blank input */
+/* lines are skipped. The input is only read once it    */
+/* has a whole line or has ended, so while it is slow   */
+/* to come the shell still sees CTRL+C, and jobs that   */
+/* finish are collected.                                */
+/* **************************************************** */
+static char *PeekArg(Parallel *P)
+{
+    char *line;
+    size_t len;
+
+    if (P->held != NULL) return P->held;
+    if (P->list != NULL) {
+        if (*P->list == NULL) return NULL;
+        line = *P->list++;
+    } else {
+        do {
+            while (!LineReady(P->R)) {                  /* read() would block                       */
+                if (WaitInput(P->R->fd)) FillReader(P->R);
+                CheckInterrupt(P);
+                if (P->stop) return NULL;
+                Reap(P);
+            }
+            if ((line = ReadLine(P->R, &len)) == NULL) return NULL;
+        } while (!len);
+    }
+    return P->held = strdup(line);                      /* Reader reuses its buffer                 */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Copies a word of the command with every "{}" in it   */
+/* replaced by an argument                              */
+/* **************************************************** */
+static char *FillIn(Arena *A, const char *word, const char *arg)
+{
+    size_t len = strlen(arg), n = Holes(word);
+    char *out = (char *) ArenaAlloc(A, strlen(word) + n * len - 2 * n + 1), *p = out;
+    const char *hole;
+
+    while ((hole = strstr(word, "{}")) != NULL) {
+        memcpy(p, word, hole - word);
+        p += hole - word;
+        memcpy(p, arg, len);
+        p += len;
+        word = hole + 2;
+    }
+    strcpy(p, word);
+    return out;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Builds the argv for a batch of arguments. A word of  */
+/* the command with "{}" in it is repeated once per     */
+/* argument. With no "{}" the arguments go at the end.  */
+/* **************************************************** */
+static char **BuildArgv(Parallel *P, Arena *A, char **args, size_t n)
+{
+    size_t count = P->holes ? 0 : n, k = 0, a;
+    char **argv;
+    int i;
+
+    for (i = 0; i < P->nTmpl; i++)
+        count += Holes(P->tmpl[i]) ? n : 1;
+    argv = (char **) ArenaAlloc(A, (count + 1) * sizeof(char *));
+    for (i = 0; i < P->nTmpl; i++)
+        if (!Holes(P->tmpl[i]))
+            argv[k++] = P->tmpl[i];
+        else
+            for (a = 0; a < n; a++)
+                argv[k++] = FillIn(A, P->tmpl[i], args[a]);
+    for (a = 0; !P->holes && (a < n); a++)
+        argv[k++] = args[a];
+    argv[k] = NULL;
+    return argv;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Starts one command in a free slot, with as many      */
+/* arguments as -n and ARG_MAX allow. It goes in the    */
+/* job table like any other job, but is launched with   */
+/* its output going to a memfd and isn't reported on    */
+/* its own. Returns 0 once the arguments ran out.       */
+/* **************************************************** */
+static char LaunchBatch(Parallel *P, ParSlot *S)
+{
+    Arena *A;
+    char **args = NULL, **argv, *arg;
+    size_t n = 0, size = 0, used = 0, cost;
+    int fd[2];
+
+    if (P->stop || (PeekArg(P) == NULL)) return 0;
+    A = NewArena();                                     /* Owned by the job from here               */
+    while ((n < P->maxArgs) && ((arg = PeekArg(P)) != NULL)) {
+        cost = ArgCost(P, arg);
+        if (n && (used + cost > P->room)) break;        /* Left for the next command                */
+        if (n == size) {
+            args = size ? (char **) ArenaGrow(A, args, size * sizeof(char *), 2 * size * sizeof(char *))
+                        : (char **) ArenaAlloc(A, 16 * sizeof(char *));
+            size = size ? size * 2 : 16;
+        }
+        args[n++] = ArenaDup(A, arg);
+        used += cost;
+        free(P->held);
+        P->held = NULL;
+    }
+    if (P->stop) {                                      /* CTRL+C while more were read              */
+        FreeArena(A);
+        return 0;
+    }
+    argv = BuildArgv(P, A, args, n);
+
+    if ((S->out = memfd_create("parallel", MFD_CLOEXEC)) == -1) {
+        perror("memfd_create");                         /* Out of fds, run it straight to the output */
+        S->out = -1;
+    }
+    fd[0] = fcntl(P->devNull, F_DUPFD_CLOEXEC, 0);      /* Closed by LaunchMe() in the shell        */
+    fd[1] = fcntl((S->out != -1) ? S->out : P->outFd, F_DUPFD_CLOEXEC, 0);
+    S->job = AddJob(processList, A, ArenaDup(A, argv[0]), 1, 0, 1, fd);
+    S->job->printMe = 0;                                /* Summed up by RunParallel()               */
+    LaunchMe(argv, &S->job->stage[0]);
+    P->launched++;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Prints '+ completed' with how many commands ended    */
+/* with each exit code, e.g. (50 jobs: [0]x48 [1]x2),   */
+/* or (0 jobs) if there were no arguments.              */
+/* The status is the number that failed, up to 101.     */
+/* **************************************************** */
+static void CompleteParallel(Parallel *P, char *cmd)
+{
+    char msg[64];
+    unsigned long failed = P->launched - P->exits[0];
+    int code;
+
+    Emit(SE, "+ completed '", 13);
+    Emit(SE, cmd, strlen(cmd));
+    Emit(SE, msg, snprintf(msg, sizeof(msg), "' [%lu] (%lu jobs%s",
+                           (failed > PAR_FAILED) ? PAR_FAILED : failed, P->launched, P->launched ? ":" : ""));
+    for (code = 0; code < 256; code++)
+        if (P->exits[code])
+            Emit(SE, msg, snprintf(msg, sizeof(msg), " [%d]x%lu", code, P->exits[code]));
+    Emit(SE, ")\n", 2);
+}
+/* **************************************************** */
+/* Starts the stages in front of 'parallel' as a job of */
+/* their own, in the background so the shell is free to */
+/* read them, with the last one writing to a pipe. The  */
+/* job isn't reported, the line is. Its stages are only */
+/* looked at while they are launched, so the job gets a */
+/* new arena and C stays with the caller.               */
+/* Returns the job, NULL if the pipe couldn't be made.  */
+/* *in is set to the read end.                          */
+/* **************************************************** */
+static Job *Feed(Command *C, char *cmd, int *in)
+{
+    Arena *B;
+    Job *J;
+    int p[2], fd[2];
+
+    if (pipe2(p, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return NULL;
+    }
+    B = NewArena();                                     /* Owned by the job                         */
+    fd[0] = SI;
+    fd[1] = p[1];                                       /* Closed by its last stage in the shell    */
+    C->nStages--;                                       /* All but 'parallel'                       */
+    J = AddJob(processList, B, ArenaDup(B, cmd), C->nStages,
+               C->nFanOut - (C->stage[C->nStages].nTee > 0), TRUE, fd);
+    J->printMe = 0;
+    ExecProgram(C, J);                                  /* Stages that fail are marked done         */
+    C->nStages++;
+    *in = p[0];
+    return J;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* 'parallel [-j N] [-n N] [-X] cmd ... [::: args]'     */
+/* runs cmd once per argument, with up to N at a time   */
+/* (one per core by default). Arguments come from ':::' */
+/* or one per line from the input, e.g. '< list', or    */
+/* from the stages piped into it, 'seq 9 | parallel'.   */
+/* "{}" in a word is replaced by the argument,          */
+/* otherwise it is appended. -n N passes up to N        */
+/* arguments to each command, -X as many as ARG_MAX     */
+/* allows, so a long list needs far fewer execs.        */
+/* Finished slots are refilled as soon as the reaper    */
+/* marks their job done.                                */
+/* **************************************************** */
+void RunParallel(Command *C, char *cmd)
+{
+    Parallel P;
+    LineReader R;
+    Stage *S = &C->stage[C->nStages - 1];
+    int fd[2], i;
+    char busy, ready;
+
+    memset(&P, 0, sizeof(P));
+    if (strcmp(S->argv[0], "parallel")) {               /* 'parallel ... | cmd'                     */
+        ThrowError("Error: parallel must be the last stage of a pipeline");
+        CompleteCmd(cmd, 1);
+        return;
+    }
+    if ((i = ParseOptions(&P, S))) {
+        if (i == 1) ThrowError("Error: usage: parallel [-j jobs] [-n args] [-X] command [{}] [::: args]");
+        CompleteCmd(cmd, 1);
+        return;
+    }
+    if ((P.slot = (ParSlot *) calloc(P.jobs, sizeof(ParSlot))) == NULL) {
+        perror("calloc");
+        CompleteCmd(cmd, 1);
+        return;
+    }
+    if (Redirect(S, fd)) {                              /* Reported like a failed external launch   */
+        free(P.slot);
+        return;
+    }
+    if ((C->nStages > 1) && ((P.feed = Feed(C, cmd, &fd[0])) == NULL)) {
+        if (fd[1] != SO) close(fd[1]);
+        free(P.slot);
+        CompleteCmd(cmd, 1);
+        return;
+    }
+    if ((P.list == NULL) && isatty(fd[0])) {
+        ThrowError("Error: parallel reads its arguments from a file, a pipe or :::");
+        if (fd[1] != SO) close(fd[1]);
+        free(P.slot);
+        CompleteCmd(cmd, 1);
+        return;
+    }
+    if (P.list == NULL) {
+        InitReader(&R, fd[0]);
+        P.R = &R;
+    }
+    P.room = Room(&P);
+    P.outFd = fd[1];
+    P.devNull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    while (1) {
+        Reap(&P);
+        for (i = 0; i < P.jobs; i++)                    /* Refill the free slots                    */
+            if ((P.slot[i].job == NULL) && !LaunchBatch(&P, &P.slot[i]))
+                break;
+
+        busy = ready = 0;
+        for (i = 0; i < P.jobs; i++)
+            if (P.slot[i].job != NULL) {
+                busy = 1;
+                ready |= !P.slot[i].job->nRunning;      /* Failed to launch, nothing to wait for    */
+            }
+        if (!busy) break;
+        if (!ready) WaitEvent(FALSE);                   /* Sleep until a job ends                   */
+        CheckInterrupt(&P);
+    }
+
+    if (fd[0] != SI) close(fd[0]);                      /* A feed still writing gets SIGPIPE        */
+    while ((P.feed != NULL) && P.feed->nRunning)        /* The line ends with all of its stages     */
+        WaitEvent(FALSE);
+    CheckCompletedProcesses(processList);               /* Drops the feed                           */
+    CompleteParallel(&P, cmd);
+    free(P.slot);
+    free(P.held);                                       /* Read before CTRL+C, never used           */
+    close(P.devNull);
+    if (P.R != NULL) FreeReader(P.R);
+    if (fd[1] != SO) close(fd[1]);
+}
+/* **************************************************** */
@@ -0,0 +1,47 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include "batch.h"                                      /* Arguments are read with a LineReader             */
+
+/* **************************************************** */
+/*                  Parallel Structures                 */
+/* **************************************************** */
+#define PAR_MARGIN 2048                                 /* ARG_MAX bytes left free when -X packs arguments  */
+#define PAR_FAILED 101                                  /* Exit code cap, as GNU parallel has it            */
+#define PAR_MAX_JOBS 1024                               /* Most -j takes, the usual limit of open fds       */
+#define PAR_MAX_TEXT "1024"                             /* The same, for the error message                  */
+#define PAR_COPY   65536                                /* Buffer for outputs sendfile() can't write to     */
+
+typedef struct ParSlot {                                /* One job slot                                     */
+    Job *job;                                           /* Job running in it, NULL if free                  */
+    int out;                                            /* memfd the job's output is kept in                */
+} ParSlot;
+
+typedef struct Parallel {                               /* State of one 'parallel' command                  */
+    char **tmpl;                                        /* Command to run, "{}" marks where arguments go    */
+    int nTmpl;                                          /* Words in tmpl                                    */
+    int holes;                                          /* Words of tmpl holding "{}", 0 to append          */
+    int jobs;                                           /* Job slots, -j                                    */
+    size_t maxArgs;                                     /* Arguments per command, -n, no limit with -X      */
+    size_t room;                                        /* Bytes of arguments one command may take          */
+    char **list;                                        /* Arguments after ':::', NULL to read them         */
+    LineReader *R;                                      /* Reads one argument per line otherwise            */
+    Job *feed;                                          /* Stages piped into 'parallel', NULL once done     */
+    char *held;                                         /* Next argument, already read                      */
+    int devNull;                                        /* Input of every job                               */
+    int outFd;                                          /* Where the grouped output goes                    */
+    ParSlot *slot;                                      /* jobs slots                                       */
+    unsigned long launched;                             /* Commands run                                     */
+    char stop;                                          /* Ctrl-C, nothing more is launched                 */
+    char lost;                                          /* 1 once writing the output failed                 */
+    unsigned long exits[256];                           /* Commands that ended with each exit code          */
+} Parallel;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                  Parallel Functions                  */
+/* **************************************************** */
+void RunParallel(Command *C, char *cmd);                /* 'parallel', fans a command out over its input    */
+/* **************************************************** */
+
+#endif
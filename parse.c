@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* **************************************************** */
+/*              User - defined .h files                 */
+/* **************************************************** */
+#include "common.h"                                     /* Error messages and character checks      */
+#include "parse.h"                                      /* Stage and Command structures             */
+#include "env.h"                                        /* VarName()                                */
+/* **************************************************** */
+
+/* **************************************************** */
+/* Checks if a character ends a word without whitespace */
+/* **************************************************** */
+static char Check4Meta(char key)
+{
+    return (key == '|') || Check4Special(key);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Appends an empty stage to the command. The stage     */
+/* array doubles when it is full, so any number of      */
+/* pipes costs amortized O(1) per stage.                */
+/* **************************************************** */
+static Stage *NewStage(Command *C, Arena *A)
+{
+    Stage *S;
+    if (C->nStages == C->stageSlots) {                  /* Out of room, double it                   */
+        C->stage = (Stage *) ArenaGrow(A, C->stage, C->stageSlots * sizeof(Stage),
+                                       2 * C->stageSlots * sizeof(Stage));
+        C->stageSlots *= 2;
+    }
+    S = &C->stage[C->nStages++];
+    S->argSlots = TOKEN_CHUNK;                          /* Enough for most commands                 */
+    S->argv    = (char **) ArenaAlloc(A, S->argSlots * sizeof(char *));
+    S->argc    = 0;
+    S->inFile  = NULL;                                  /* No redirects yet                         */
+    S->hereEnd = NULL;
+    S->inText  = NULL;
+    S->inLen   = 0;
+    S->outFile = NULL;
+    S->teeFile = NULL;                                  /* Only made for a second '>'               */
+    S->nTee    = 0;
+    S->teeSlots = 0;
+    S->assign  = NULL;                                  /* Only made for a NAME=value word          */
+    S->nAssign = 0;
+    S->assignSlots = 0;
+    return S;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Reports a '<', '<<', '<<<' or '>' that has nothing   */
+/* after it                                             */
+/* **************************************************** */
+static char MissingFile(char sym)
+{
+    if (sym == '>') NoOutputFile();                     /* Error: no output file                    */
+    else NoInputFile();                                 /* Error: no input file                     */
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Checks if a stage already has its input redirected   */
+/* **************************************************** */
+static char HasInput(Stage *S)
+{
+    return (S->inFile != NULL) || (S->hereEnd != NULL) || (S->inText != NULL);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Makes word, plus the '\n' a '<<<' string ends with,  */
+/* the stage's input. The only copy the parser makes,   */
+/* there is no room for the '\n' in the line.           */
+/* **************************************************** */
+static void HereString(Stage *S, const char *word, Arena *A)
+{
+    size_t len = strlen(word);
+    S->inText = (char *) memcpy(ArenaAlloc(A, len + 1), word, len);
+    S->inText[len] = '\n';
+    S->inLen = len + 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the ')' closing the "$(" p points just past, */
+/* counting the parentheses nested in it, or NULL if    */
+/* the line ends first                                  */
+/* **************************************************** */
+char *MatchParen(char *p)
+{
+    int depth = 1;
+    for (; *p != '\0'; p++)
+        if (*p == '(') depth++;
+        else if ((*p == ')') && !--depth) return p;
+    return NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Appends an argument to a stage, doubling argv when   */
+/* it is full. One slot is always left for the NULL.    */
+/* **************************************************** */
+void AddArg(Stage *S, char *word, Arena *A)
+{
+    if (S->argc + 1 == S->argSlots) {                   /* Only the NULL slot left, double it       */
+        S->argv = (char **) ArenaGrow(A, S->argv, S->argSlots * sizeof(char *),
+                                      2 * S->argSlots * sizeof(char *));
+        S->argSlots *= 2;
+    }
+    S->argv[S->argc++] = word;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Adds a file after the stage's first '>', the output  */
+/* goes to all of them. The array is made on the first, */
+/* and doubles when it is full.                         */
+/* **************************************************** */
+static void AddTee(Command *C, Stage *S, char *word, Arena *A)
+{
+    if (!S->teeSlots) {                                 /* First one, the stage gets a relay        */
+        S->teeSlots = TEE_CHUNK;
+        S->teeFile = (char **) ArenaAlloc(A, S->teeSlots * sizeof(char *));
+        C->nFanOut++;
+    } else if (S->nTee == S->teeSlots) {                /* Out of room, double it                   */
+        S->teeFile = (char **) ArenaGrow(A, S->teeFile, S->teeSlots * sizeof(char *),
+                                         2 * S->teeSlots * sizeof(char *));
+        S->teeSlots *= 2;
+    }
+    S->teeFile[S->nTee++] = word;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Checks if a word is NAME=value                       */
+/* **************************************************** */
+static char IsAssign(const char *word)
+{
+    size_t len = VarName(word);
+    return len && (word[len] == '=');
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Adds a NAME=value word that comes before the stage's */
+/* program. The array is made on the first, and doubles */
+/* when it is full.                                     */
+/* **************************************************** */
+static void AddAssign(Stage *S, char *word, Arena *A)
+{
+    if (!S->assignSlots) {
+        S->assignSlots = ENV_CHUNK;
+        S->assign = (char **) ArenaAlloc(A, S->assignSlots * sizeof(char *));
+    } else if (S->nAssign == S->assignSlots) {          /* Out of room, double it                   */
+        S->assign = (char **) ArenaGrow(A, S->assign, S->assignSlots * sizeof(char *),
+                                        2 * S->assignSlots * sizeof(char *));
+        S->assignSlots *= 2;
+    }
+    S->assign[S->nAssign++] = word;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Splits a command line into pipeline stages, argv and */
+/* redirect files in a single left to right pass.       */
+/* Words are terminated in place, so every token points */
+/* into line and nothing is copied. Bad placement of    */
+/* |<>& is reported as soon as it is seen.              */
+/*                                                      */
+/* "ls -la|grep c> out &" gives 2 stages:               */
+/*      {"ls", "-la", NULL}                             */
+/*      {"grep", "c", NULL}, outFile = "out"            */
+/* and isBG = 1. "ls >a >b | wc" fans the output of ls  */
+/* out to a, b and the pipe. "cat <<END" only records   */
+/* the delimiter "END", ReadHereDocs() reads the body.  */
+/* A "$(...)" is kept whole in its word, spaces and |<> */
+/* included, for ExpandCommand() to run, and it fills   */
+/* in $NAME and ${NAME} too. "X=1 Y=2 env" puts X=1 and */
+/* Y=2 in the stage's assign array, only "env" is argv. */
+/* A line of only NAME=value words is one stage with no */
+/* argv.                                                */
+/* Returns 0 if good command, 1 if bad command          */
+/* **************************************************** */
+char ParseCommand(char *line, Command *C, Arena *A)
+{
+    char c, pending = 0;                                /* '<', '>', '<<' (H), '<<<' (S) still open */
+    char *p = line, *word;
+    Stage *S;
+
+    C->stageSlots = TOKEN_CHUNK;                        /* Enough for most pipelines                */
+    C->stage   = (Stage *) ArenaAlloc(A, C->stageSlots * sizeof(Stage));
+    C->nStages = 0;
+    C->nHere   = 0;
+    C->nFanOut = 0;
+    C->nSubst  = 0;
+    C->isBG    = 0;
+
+    while (Check4Space(*p)) p++;                        /* Skip leading whitespace                  */
+    if (*p == '\0') return 0;                           /* Blank line, nothing to run               */
+    if (Check4Meta(*p)) {                               /* Can't start with | < > or &              */
+        InvalidCommand();
+        return 1;
+    }
+    S = NewStage(C, A);
+
+    while (1) {
+        while (Check4Space(*p)) p++;                    /* Skip whitespace between tokens           */
+        c = *p;
+        if ((c != '\0') && !Check4Meta(c)) {            /* A word                                   */
+            word = p;
+            while ((*p != '\0') && !Check4Space(*p) && !Check4Meta(*p))
+                if ((*p == '$') && (p[1] == '(')) {     /* Command substitution, up to its ')'      */
+                    if ((p = MatchParen(p + 2)) == NULL) {
+                        ThrowError("Error: missing )");
+                        return 1;
+                    }
+                    C->nSubst++;
+                    p++;
+                } else {
+                    if ((*p == '$') && ((p[1] == '{') || VarName(p + 1)))
+                        C->nSubst++;                    /* Variable, filled in with the $(...)s     */
+                    p++;
+                }
+            c = *p;                                     /* Keep what ended the word                 */
+            *p = '\0';                                  /* before terminating it in place           */
+
+            if (pending == '<') S->inFile = word;       /* File for the last redirect               */
+            else if ((pending == '>') && (S->outFile == NULL)) S->outFile = word;
+            else if (pending == '>') AddTee(C, S, word, A);
+            else if (pending == 'S') HereString(S, word, A);
+            else if (pending == 'H') {                  /* Body comes from the next lines           */
+                S->hereEnd = word;
+                C->nHere++;
+            }
+            else if (!S->argc && IsAssign(word))        /* Before the program, for its environment  */
+                AddAssign(S, word, A);
+            else AddArg(S, word, A);                    /* Otherwise another argument               */
+            pending = 0;
+
+            if (c == '\0') break;                       /* End of the line                          */
+            if (Check4Space(c)) {                       /* Word ended on whitespace                 */
+                p++;
+                continue;
+            }
+        }
+        if (c == '\0') break;                           /* End of the line                          */
+        p++;                                            /* Consume the | < > or &                   */
+        if (pending) return MissingFile(pending);       /* Redirect followed by another symbol      */
+
+        switch (c) {
+            case '|':
+                if (S->argc == 0) {                     /* Nothing to run before the pipe           */
+                    InvalidCommand();
+                    return 1;
+                }
+                if ((S->outFile != NULL) && !S->nTee) { /* One file out and the pipe, unless fanned */
+                    BadOutputRedirect();
+                    return 1;
+                }
+                S->argv[S->argc] = NULL;                /* Terminate this stage's argv              */
+                S = NewStage(C, A);
+                break;
+
+            case '<':
+                if (C->nStages > 1) {                   /* Can't have piped input & file input      */
+                    BadInputRedirect();
+                    return 1;
+                }
+                if (HasInput(S)) {                      /* Only one input                           */
+                    ThrowError("Error: mislocated redirection");
+                    return 1;
+                }
+                pending = c;
+                if (*p == '<') {                        /* '<<' here-document, '<<<' here-string    */
+                    pending = (*++p == '<') ? 'S' : 'H';
+                    if (pending == 'S') p++;
+                }
+                break;
+
+            case '>':                                   /* A second '>' fans the output out         */
+                pending = c;
+                break;
+
+            case '&':
+                while (Check4Space(*p)) p++;
+                if (*p != '\0') {                       /* '&' must be the last character           */
+                    ThrowError("Error: mislocated background sign");
+                    return 1;
+                }
+                C->isBG = 1;                            /* Set the Background flag                  */
+                break;
+        }
+    }
+
+    if (pending) return MissingFile(pending);           /* Line ended right after a redirect        */
+    if ((S->argc == 0) && (!S->nAssign || (C->nStages > 1))) { /* No program, and not just NAME=value */
+        InvalidCommand();
+        return 1;
+    }
+    S->argv[S->argc] = NULL;                            /* Terminate the last stage's argv          */
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Reads the body of every '<<' from the lines more()   */
+/* returns, up to the line that is just the delimiter.  */
+/* Bodies are appended in the command's arena, which    */
+/* doubles them in place while they are its newest      */
+/* allocation.                                          */
+/* Returns 0 if good, 1 if input ended before one of    */
+/* the delimiters                                       */
+/* **************************************************** */
+char ReadHereDocs(Command *C, Arena *A, MoreFn more, void *ctx)
+{
+    Stage *S;
+    char *line;
+    size_t len, room, grown;
+    int N;
+
+    for (N = 0; (N < C->nStages) && C->nHere; N++) {
+        S = &C->stage[N];
+        if (S->hereEnd == NULL) continue;               /* No '<<' on this stage                    */
+        room = HERE_CHUNK;
+        S->inText = (char *) ArenaAlloc(A, room);
+        while (1) {
+            if ((more == NULL) || ((line = more(ctx, &len)) == NULL)) {
+                ThrowError("Error: here-document ended before its delimiter");
+                return 1;
+            }
+            if (!strcmp(line, S->hereEnd)) break;       /* Delimiter, the body is complete          */
+            if (S->inLen + len + 1 > room) {            /* Out of room, double it                   */
+                for (grown = 2 * room; S->inLen + len + 1 > grown; grown *= 2);
+                S->inText = (char *) ArenaGrow(A, S->inText, room, grown);
+                room = grown;
+            }
+            memcpy(S->inText + S->inLen, line, len);
+            S->inLen += len;
+            S->inText[S->inLen++] = '\n';               /* Lines keep their '\n'                    */
+        }
+        C->nHere--;
+    }
+    return 0;
+}
+/* **************************************************** */
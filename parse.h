@@ -0,0 +1,52 @@
+#ifndef _PARSE_H
+#define _PARSE_H
+
+#include "arena.h"                                      /* Parsed commands live in the line's arena         */
+
+/* **************************************************** */
+/*                   Parser Structures                  */
+/* **************************************************** */
+#define HERE_CHUNK 256                                  /* First room for a here-document, doubled as needed */
+#define TEE_CHUNK  4                                    /* First room for extra '>' files                   */
+#define ENV_CHUNK  4                                    /* First room for a stage's NAME=value words        */
+
+typedef struct Stage {                                  /* One command of a pipeline                        */
+    char **argv;                                        /* NULL terminated, points into the command line    */
+    int argc;                                           /* Number of arguments in argv                      */
+    int argSlots;                                       /* Room in argv, doubled when it fills up           */
+    char *inFile;                                       /* File after '<', NULL if none                     */
+    char *hereEnd;                                      /* Delimiter after '<<', NULL if none               */
+    char *inText;                                       /* Here-document or '<<<' string, NULL if none      */
+    size_t inLen;                                       /* Bytes in inText                                  */
+    char *outFile;                                      /* File after '>', NULL if none                     */
+    char **teeFile;                                     /* Files after a 2nd, 3rd, ... '>' on the stage     */
+    int nTee;                                           /* Number of them, the output is fanned out if > 0  */
+    int teeSlots;                                       /* Room in teeFile, doubled when it fills up        */
+    char **assign;                                      /* NAME=value words before argv, its environment    */
+    int nAssign;                                        /* Number of them                                   */
+    int assignSlots;                                    /* Room in assign, doubled when it fills up         */
+} Stage;
+
+typedef struct Command {                                /* One parsed command line                          */
+    Stage *stage;                                       /* Stages in pipeline order                         */
+    int nStages;                                        /* Number of stages, 0 for a blank line             */
+    int stageSlots;                                     /* Room in stage, doubled when it fills up          */
+    int nHere;                                          /* Stages whose '<<' body is still to be read       */
+    int nFanOut;                                        /* Stages whose output goes to several sinks        */
+    int nSubst;                                         /* "$(...)"s and $NAMEs in words, expanded first    */
+    char isBG;                                          /* 1 if the line ended in '&'                       */
+} Command;
+
+typedef char *(*MoreFn)(void *ctx, size_t *len);        /* Next input line, NULL once there is no more      */
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Parser Functions                   */
+/* **************************************************** */
+char ParseCommand(char *line, Command *C, Arena *A);    /* Split a line into stages in one pass             */
+char ReadHereDocs(Command *C, Arena *A, MoreFn more, void *ctx); /* Bodies of the '<<'s, from the next lines */
+char *MatchParen(char *p);                              /* ')' closing a "$(", NULL if there is none        */
+void AddArg(Stage *S, char *word, Arena *A);            /* Append to argv, doubling it when it is full      */
+/* **************************************************** */
+
+#endif
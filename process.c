@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 /* **************************************************** */
@@ -8,188 +10,261 @@
 /* **************************************************** */
 #include "process.h"                                    /* Process structures and methods           */
 #include "common.h"                                     /* Keystrokes and common functions          */
+#include "trace.h"                                      /* Stage lifetimes and the "report" span    */
 /* **************************************************** */
+ProcessList *processList;                               /* Global job table                         */
 /* **************************************************** */
-/* Add a process to the list of running processes       */
 /* **************************************************** */
-Process *AddProcess(ProcessList *pList, pid_t PID, char *cmd, char nPipes, char isBG, int *fd)
+/* Monotonic clock in seconds                           */
+/* **************************************************** */
+static double Now(void)
 {
-    Process *curr;
-    Process *me = (Process*) malloc(sizeof(Process));
-    me->cmd     = (char*) malloc(strlen(cmd)+1);        /* Alloc space for the cmd                  */
-    me->PID     = PID;                                  /* Set the PID                              */
-    me->status  = 0;                                    /* exit code                                */
-    me->running = 1;                                    /* 1 if running, 0 if complete              */
-    me->isBG    = isBG;                                 /* 1 if background command, 0 otherwise     */
-    me->nPipes  = nPipes;                               /* Number of pipes in the command           */
-    me->child   = NULL;	                       	        /* NULL if no children processes            */
-    me->parent  = NULL;                                 /* @TODO Should be set to main shell PID    */
-    me->fd[0]   = fd[0];                                /* Input file descriptor                    */
-    me->fd[1]   = fd[1];                                /* Output file descriptor                   */
-    me->printMe = 1;                                    /* By default, print '+ completed' messages */
-    strcpy(me->cmd, cmd);                               /* Copy the command string                  */
-    me->next = NULL;                                    /* No newer nodes in list yet 	            */
-    if (pList->top == NULL)                             /* Setup pointer to next process in list    */
-        pList->top = me;
-    else {                                              /* If already entries in the list 	    */
-        curr = pList->top;
-        while (curr->next != NULL) curr = curr->next;   /* Go to the end of the list                */
-        curr->next = me;                                /* Set the next pointer to the new process  */
-   }
-
-    pList->count++;                                     /* Increment count of processes in the list */
-    return me;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Add a job to the table. The job and its stage array  */
+/* are carved out of the command line's arena, which    */
+/* already holds cmd. The job owns the arena from now.  */
+/* Relays are processes of the job too, so it is only   */
+/* done once they have written out all of its output,   */
+/* but they get no exit code in its message.            */
+/* **************************************************** */
+Job *AddJob(ProcessList *pList, Arena *A, char *cmd, int nPipes, int nRelays, char isBG, int *fd)
+{
+    int i;
+    Job *J      = (Job *) ArenaAlloc(A, sizeof(Job) + (nPipes + nRelays) * sizeof(Process));
+    J->arena    = A;                                    /* Released when the job is removed         */
+    J->stage    = (Process *) (J + 1);                  /* Stages follow the job header             */
+    J->cmd      = cmd;                                  /* Command string, already in the arena     */
+    J->isBG     = isBG;                                 /* 1 if background command, 0 otherwise     */
+    J->printMe  = 1;                                    /* By default, print '+ completed' messages */
+    J->timeMe   = 0;                                    /* No usage suffix unless asked for         */
+    J->id       = pList->tail ? pList->tail->id + 1 : 1;/* One past the newest job, as in bash      */
+    J->pgid     = 0;                                    /* Set by the first stage launched          */
+    J->nPipes   = nPipes;                               /* Number of stages in the command          */
+    J->nRelays  = nRelays;                              /* One per stage with several '>' files     */
+    J->nRunning = nPipes + nRelays;                     /* No stage has completed yet               */
+    J->nStopped = 0;
+    J->doneNext = NULL;
+
+    for (i = 0; i < nPipes + nRelays; i++) {
+        J->stage[i].PID     = 0;                        /* Set when the stage is launched           */
+        J->stage[i].running = 1;                        /* 1 if running, 0 if complete              */
+        J->stage[i].stopped = 0;
+        J->stage[i].status  = 0;                        /* exit code                                */
+        J->stage[i].fd[0]   = fd[0];                    /* Input file descriptor                    */
+        J->stage[i].fd[1]   = fd[1];                    /* Output file descriptor                   */
+        J->stage[i].envp    = NULL;                     /* The shell's, unless NAME=value is given  */
+        memset(&J->stage[i].use, 0, sizeof(Usage));     /* Stages that never ran used nothing       */
+        J->stage[i].job     = J;                        /* Back pointer for the reaper              */
+        J->stage[i].hnext   = NULL;
+    }
+
+    J->next = NULL;                                     /* Newest job in the table                  */
+    J->prev = pList->tail;                              /* Append after the old tail                */
+    if (pList->tail == NULL) pList->top = J;
+    else pList->tail->next = J;
+    pList->tail = J;
+
+    pList->count++;                                     /* Increment count of jobs in the table     */
+    return J;
 }
 /* **************************************************** */
 
 /* **************************************************** */
-/* Add a process as a child of another processs         */
+/* Hash a launched stage by its PID so the reaper       */
+/* finds it in O(1).                                    */
 /* **************************************************** */
-Process *AddProcessAsChild(ProcessList *pList, Process *P, pid_t cPID, char *cmd)
+void AddProcess(ProcessList *pList, Process *Me, pid_t PID)
 {
-    Process *child = (Process*) AddProcess(pList, cPID, cmd, P->nPipes, P->isBG, P->fd);
-    P->child = child;                                   /* Mark the process as "child" of parent    */
-    child->parent = P;                                  /* Mark the parent of the "child"           */
-    return child;                                       /* Return the pointer                       */
+    Process **bucket = &pList->table[PID & (PID_BUCKETS-1)];
+    Me->PID   = PID;                                    /* Set the PID                              */
+    Me->start = Now();                                  /* Wall time counts from here               */
+    Me->hnext = *bucket;                                /* Push on the front of the bucket          */
+    *bucket   = Me;
 }
 /* **************************************************** */
 
 /* **************************************************** */
-/* Prints '+ completed' messages for piped commands     */
+/* Mark a stage as completed. When it was the last      */
+/* stage running, the job joins the completed queue.    */
 /* **************************************************** */
-void CompleteChain (Process *P, int *xArray)
+void StageDone(ProcessList *pList, Process *Me, int status)
 {
-    char msg[2*MAX_BUFFER];                             /* @TODO minimize this buffer size          */
-    int i = 0;
-    sprintf(msg, "+ completed '%s' [%d]", P->cmd, xArray[i]);
+    Job *J = Me->job;
+    if (!Me->running) return;                           /* Already accounted for                    */
+    Me->running = 0;
+    Me->status  = status;
+    if (Me->stopped) {                                  /* Killed while stopped                     */
+        Me->stopped = 0;
+        J->nStopped--;
+    }
+    if (--J->nRunning) return;                          /* Other stages still running               */
 
-    while(++i < P->nPipes) 
-	sprintf(msg, "%s[%d]", msg, xArray[i]);
+    if (pList->doneTail == NULL) pList->doneTop = J;    /* Append to the completed queue            */
+    else pList->doneTail->doneNext = J;
+    pList->doneTail = J;
+}
+/* **************************************************** */
 
-    sprintf(msg, "%s\n", msg);
-    write(STDERR_FILENO, msg, strlen(msg));
+/* **************************************************** */
+/* Mark the stage with matching PID as stopped, or as   */
+/* running again once it is continued.                  */
+/* **************************************************** */
+void StageStopped(ProcessList *pList, pid_t PID, char stopped)
+{
+    Process *Me = FindProcess(pList, PID);
+    if ((Me == NULL) || (Me->stopped == stopped)) return;
+    Me->stopped = stopped;
+    Me->job->nStopped += stopped ? 1 : -1;
 }
 /* **************************************************** */
+
 /* **************************************************** */
-/* Record the status of each chained process and free   */
-/* it from the list. Return pointer to status array     */
+/* Returns the running stage with matching PID, or NULL */
 /* **************************************************** */
-int *GetChainStatus(Process *P)
+Process *FindProcess(ProcessList *pList, pid_t PID)
 {
-    int i = 0;
-    Process *My = P;
-    int *status = (int *)malloc(4*(P->nPipes));         /* Allocate space for status array  */
-    while(My->child != NULL) {                          /* Iterate through children         */
-	    status[i++] = My->child->status;            /* Add the value to the array       */
-	    if (My->child->child == NULL) break;        
-	    P->child = CopyDelete(My->child, My->child->child);       
-        P->child->parent = P;                      
-    }
-    status[i] = P->status;                              /* Parent is always last command    */
-    P->next = My->child->next;                          /* Remove pointer from the list     */
-    P->child = NULL;                                    /* Deleted all the children         */
-    free(My->child);                                    /* Free the child -delete from list */
-    if(processList->count) processList->count--;        /* Decrement the process count      */
-    return status;                                      /* Return the pointer               */
+    Process *Me = pList->table[PID & (PID_BUCKETS-1)];
+    while ((Me != NULL) && (Me->PID != PID))            /* Only the PIDs sharing this bucket        */
+        Me = Me->hnext;
+    return Me;
 }
 /* **************************************************** */
+
 /* **************************************************** */
-/* Check if chained process's children have finished    */
-/* Return 1 if all finished, 0 if any still running     */
+/* Mark process with matching PID as completed, and     */
+/* keep what wait4() said it used. ru may be NULL.      */
+/* return 1 if matching PID in table, 0 otherwise       */
 /* **************************************************** */
-char CheckChildrenDone(Process *My)
+char MarkProcessDone(ProcessList *pList, pid_t PID, int status, struct rusage *ru)
 {
-    while(My->child != NULL) {                          /* Iterate through children         */
-        if (My->child->running) return 0;               /* Still running, return 0          */
-        My = My->child;                                 /* Update the pointer               */
+    Process **link = &pList->table[PID & (PID_BUCKETS-1)];
+    while (*link != NULL) {                             /* Only the PIDs sharing this bucket        */
+        if ((*link)->PID == PID) {                      /* Found the completed PID                  */
+            Process *Me = *link;
+            *link = Me->hnext;                          /* Unhash it, the PID may be reused         */
+            Me->use.wall = Now() - Me->start;
+            if (ru != NULL) {
+                Me->use.user   = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+                Me->use.sys    = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+                Me->use.maxRSS = ru->ru_maxrss;         /* Already in KiB on Linux                  */
+            }
+            StageDone(pList, Me, status);
+            if (tracing) TraceStage(Me);                /* Launch to exit, on the stage's track     */
+            return 1;
+        }
+        link = &(*link)->hnext;
     }
-    if (My->running) return 0;                          /* Last child still running         */
-    return 1;                                           /* Otherwise all done               */
+    return 0;                                           /* Process was not in the table             */
 }
 /* **************************************************** */
 
 /* **************************************************** */
-/* Check if any processes have completed                */
-/* Print completed message if they have                 */
+/* Reads the bytes a stage read and wrote. Has to be    */
+/* called while the child is a zombie, /proc/<pid> is   */
+/* gone once it is reaped.                              */
 /* **************************************************** */
-void CheckCompletedProcesses(ProcessList *pList)
+void ReadStageIO(Process *Me)
 {
-    int *stArray;
-    Process *curr = pList->top;
-    Process *prev = NULL;
-   
-    while (curr != NULL) {                              /* Iterate through the list                     */
-        if ((curr->running==0)&&(curr->parent==NULL)){  /* If process completed, and no children exist  */
-            if (curr->nPipes > 1) {                     /* If it's a chained process                    */
-                if(CheckChildrenDone(curr)) {           /* Check all children completed                 */
-                    stArray = GetChainStatus(curr);     /* Save exit status, delete all                 */
-                    CompleteChain(curr, stArray);       /* Print completed message                      */
-                }
-            }
-            else if(curr->printMe) {                    /* Otherwise,not piped, check print enabled     */
-                CompleteCmd(curr->cmd, curr->status);   /* If it is, print + completed message          */
-            }
-	        
-            if (curr->next != NULL) {                   /* If there are more processes in the list      */
-                CopyDelete(curr, curr->next);           /* Copy curr->next to curr and delete next      */
-                if (prev == NULL)                       /* If this is the top node in the list          */
-		            pList->top = curr;          /* Assign the top pointer to the current node   */
-	        }
-           
-            else {                                      /* Otherwise, no more processes in the list     */
-                free(curr);                             /* So free the node                             */
-		        pList->top = NULL;              /* Point the top to NULL                        */
-		        if(pList->count) pList->count--;/* Decrement the process count, prevent -1      */
-	    	    break;                              /* Break from the while  loop                   */
-            }
-            if(pList->count) pList->count--;            /* Decrement the process count, loop again      */
-        } else {                                        /* No completed processes found yet, keep going */
-            prev = curr;            
-            curr = curr->next;    
-        }                                               /* End if process completed with no children    */
-    }						        /* End while loop 				*/
+    char path[32], buf[512], *p;
+    int fd;
+    ssize_t got;
+
+    sprintf(path, "/proc/%d/io", (int) Me->PID);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return;
+    got = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (got <= 0) return;
+    buf[got] = '\0';
+
+    if ((p = strstr(buf, "rchar: ")) != NULL) Me->use.rchar = strtoull(p + 7, NULL, 10);
+    if ((p = strstr(buf, "wchar: ")) != NULL) Me->use.wchar = strtoull(p + 7, NULL, 10);
 }
+/* **************************************************** */
 
 /* **************************************************** */
-/* Mark process with matching PID as completed          */
-/* return 1 if matching PID in list, 0 otherwise        */
+/* Asks for the job's resource usage to be reported     */
+/* with its '+ completed' message                       */
 /* **************************************************** */
-char MarkProcessDone(ProcessList *pList, pid_t PID, int status)
+void TimeJob(ProcessList *pList, Job *J)
 {
-    Process *current = pList->top;                      
-    while(current != NULL) {                            /* Iterate through the process list             */
-        if (current->PID == PID) {                      /* Check to find the PID = completed PID        */
-            current->running = 0;
-            current->status = status;
-            return 1;
-        }
-        current = current->next;
+    if (J->timeMe) return;
+    J->timeMe = 1;
+    pList->timing++;                                    /* Reaper now reads /proc/<pid>/io          */
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Unlink a job from the table and free its arena       */
+/* **************************************************** */
+void RemoveJob(ProcessList *pList, Job *J)
+{
+    if (J->prev == NULL) pList->top = J->next;          /* Unlink from the launch order list        */
+    else J->prev->next = J->next;
+    if (J->next == NULL) pList->tail = J->prev;
+    else J->next->prev = J->prev;
+
+    if(pList->count) pList->count--;                    /* Decrement the job count                  */
+    if (J->timeMe) pList->timing--;
+    FreeArena(J->arena);                                /* Stages, cmd and parse data go with it    */
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Prints '+ completed' messages for piped commands,    */
+/* and for timed jobs, followed by the resources each   */
+/* stage used, in pipeline order                        */
+/* **************************************************** */
+void CompleteChain (Job *J)
+{
+    size_t size = 14 * J->nPipes + 3 + (J->timeMe ? 160 * J->nPipes + 2 : 0); /* Codes, then usage */
+    char *msg = (char *) ArenaAlloc(J->arena, size);
+    Usage *U;
+    int i, len;
+    len = sprintf(msg, "' ");
+
+    for (i = 0; i < J->nPipes; i++)                     /* One exit code per stage                  */
+        len += sprintf(msg + len, "[%d]", J->stage[i].status);
+
+    for (i = 0; J->timeMe && (i < J->nPipes); i++) {    /* Which stage burned the CPU               */
+        U = &J->stage[i].use;
+        len += sprintf(msg + len, "%sreal %.3fs user %.3fs sys %.3fs rss %ldK io %llu/%llu",
+                       i ? " | " : " (", U->wall, U->user, U->sys, U->maxRSS, U->rchar, U->wchar);
     }
-    return 0;                                           /* Process was not in the list                  */
+    if (J->timeMe) msg[len++] = ')';
+
+    msg[len++] = '\n';
+    Emit(STDERR_FILENO, "+ completed '", 13);           /* Queued with the rest of the event        */
+    Emit(STDERR_FILENO, J->cmd, strlen(J->cmd));
+    Emit(STDERR_FILENO, msg, len);
 }
 /* **************************************************** */
+
 /* **************************************************** */
-/* Copy and delete a process from the list              */
+/* Report jobs on the completed queue, then remove them */
+/* Only completed jobs are visited, not the whole table */
 /* **************************************************** */
-Process *CopyDelete(Process  *To, Process *From)
+void CheckCompletedProcesses(ProcessList *pList)
 {
-    if (From !=NULL) {                                  /* Don't do anything if From node is NULL 	*/
-        To->cmd     = From->cmd;                        /* Copy the command string                      */
-        To->PID     = From->PID;                        /* Copy the PID                                 */
-        To->status  = From->status;                     /* Copy the exit status                         */
-        To->running = From->running;                    /* Copy the state                               */	 			     
-        To->isBG    = From->isBG;                       /* Copy the background flag                     */
-        To->nPipes  = From->nPipes;                     /* Copy the number of piped commands            */
-        To->child   = From->child;                      /* Copy the pointer to a child                  */             
-        To->parent  = NULL;                             /* Avoid segfaults, set this later if needed    */
-        To->fd[0]   = From->fd[0];                      /* Copy the input file descriptor               */        
-        To->fd[1]   = From->fd[1];                      /* Copy the input file descriptor               */     
-        To->printMe = From->printMe;                    /* Copy the print settings descriptor 		*/    
-        To->next    = From->next;                       /* Copy the pointer to the next node in list    */
-        free(From);                                     /* Delete the From node           		*/
-	    if(processList->count)                      /* Prevent from becoming -1                     */
-            processList->count--;                       /* Decrement the process count                  */
+    Job *J;
+
+    if (pList->doneTop == NULL) return;                 /* Called on every wakeup, nothing to trace */
+    TRACE_BEGIN("report", NULL);
+    while ((J = pList->doneTop) != NULL) {              /* Oldest completed job first               */
+        pList->doneTop = J->doneNext;
+        if (pList->doneTop == NULL) pList->doneTail = NULL;
+
+        if (J->printMe) {                               /* Check print enabled                      */
+            if ((J->nPipes > 1) || J->timeMe)           /* Chained: one exit code per stage         */
+                CompleteChain(J);
+            else CompleteCmd(J->cmd, J->stage[0].status);
+        }
+        RemoveJob(pList, J);                            /* Job is finished, drop it                 */
     }
-    return To;                                          /* Return the copy of the process 	        */
+    TRACE_END(0);
 }
 /* **************************************************** */
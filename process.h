@@ -1,46 +1,87 @@
 #ifndef _PROCESS_H
 #define _PROCESS_H
 
+#include <sys/resource.h>                               /* struct rusage from wait4()               */
+#include "arena.h"                                      /* Jobs live in their command's arena       */
+
 /* **************************************************** */
 /*                Process Structures                    */
 /* **************************************************** */
-typedef struct Process {                                /* Process Node                             */
+#define PID_BUCKETS 1024                                /* Size of the PID hash table, a power of 2 */
+#define JobStopped(J) ((J)->nStopped && ((J)->nStopped == (J)->nRunning)) /* Every live stage stopped */
+
+typedef struct Usage {                                  /* Resources a stage used                   */
+    double wall;                                        /* Seconds from launch to exit              */
+    double user;                                        /* CPU seconds in user mode                 */
+    double sys;                                         /* CPU seconds in the kernel                */
+    long maxRSS;                                        /* Peak resident set, in KiB                */
+    unsigned long long rchar;                           /* Bytes read, from /proc/<pid>/io          */
+    unsigned long long wchar;                           /* Bytes written, from /proc/<pid>/io       */
+} Usage;
+
+typedef struct Process {                                /* One stage of a job                       */
     pid_t PID;	                                        /* PID of command that was run              */
     char running;                                       /* 1 if running, 0 if complete              */
-    char isBG;                                          /* 1 if background command, 0 otherwise     */
-    char *cmd;                                          /* command that was executed                */
+    char stopped;                                       /* 1 while stopped by a signal              */
     int status;                                         /* Completion status when process completed */
-    char nPipes;                                        /* Number of pipes in the command           */
     int fd[2];                                          /* Input/Output file descriptor             */
-    char printMe;                                       /* 1 if should print '+completed' messages  */
-    struct Process *next;                               /* points to next process in list           */
-    struct Process *child;                              /* Points to child process if it exists     */
-    struct Process *parent;                             /* Points to parent process                 */
+    char **envp;                                        /* Environment it execs with, NULL: environ */
+    double start;                                       /* Launch time, CLOCK_MONOTONIC seconds     */
+    Usage use;                                          /* Filled in when the stage is reaped       */
+    struct Job *job;                                    /* Job this stage belongs to                */
+    struct Process *hnext;                              /* Next stage in the same PID bucket        */
 } Process;
 
-typedef struct ProcessList {                            /* Maintains list of running processes      */
-    unsigned int count;                                 /* Number of outstanding processes          */
-    Process *top;                                       /* Top process in the list                  */
+typedef struct Job {                                    /* One command line, piped or not           */
+    Arena *arena;                                       /* Holds the job, its stages and parse data */
+    char *cmd;                                          /* command that was executed                */
+    char isBG;                                          /* 1 if background command, 0 otherwise     */
+    char printMe;                                       /* 1 if should print '+completed' messages  */
+    char timeMe;                                        /* 1 if the message gets the usage suffix   */
+    int id;                                             /* Job number, %id in fg, bg, wait and kill */
+    pid_t pgid;                                         /* Process group, 0 without job control     */
+    int nPipes;                                         /* Number of stages (pipes + 1)             */
+    int nRelays;                                        /* Relays of fanned out stages, after them  */
+    int nRunning;                                       /* Stages that have not completed yet       */
+    int nStopped;                                       /* Running stages that are stopped          */
+    Process *stage;                                     /* nPipes stages, then nRelays relays       */
+    struct Job *next;                                   /* Newer job in launch order                */
+    struct Job *prev;                                   /* Older job in launch order                */
+    struct Job *doneNext;                               /* Next job in the completed queue          */
+} Job;
+
+typedef struct ProcessList {                            /* Job table                                */
+    unsigned int count;                                 /* Number of jobs not yet reported          */
+    unsigned int timing;                                /* Jobs in the table with timeMe set        */
+    Job *top;                                           /* Oldest job in the table                  */
+    Job *tail;                                          /* Newest job, so inserts are O(1)          */
+    Job *doneTop;                                       /* Completed jobs, oldest first             */
+    Job *doneTail;                                      /* Last completed job                       */
+    Process *table[PID_BUCKETS];                        /* Running stages hashed by PID             */
 } ProcessList;
 /* **************************************************** */
  
 /* **************************************************** */
 /*                  Global Structures                   */
 /* **************************************************** */
-ProcessList *processList;                               /* Global->easy access from signal handler  */
+extern ProcessList *processList;                        /* Global->easy access from the reaper      */
 /* **************************************************** */
 
 /* **************************************************** */
 /*                       Process                        */
 /* **************************************************** */
-void CompleteChain (Process *P, int *xArray);                                         /* Prints '+ completed' messages for chains       */
-int *GetChainStatus(Process *P);                                                      /* Get the exit status codes from piped commands  */
-Process *CopyDelete(Process *To, Process *From);                                      /* Copy a process to another process, then delete */
-void CheckCompletedProcesses(ProcessList *pList);                                     /* Check if any processes have completed          */
-char MarkProcessDone(ProcessList *pList, pid_t PID, int status);                      /* Mark process with matching PID as completed    */
-Process *AddProcessAsChild(ProcessList *pList, Process *P, pid_t cPID, char *cmd);    /* Create a new process marked as child of parent */
-/* Constructor - Add a process to the list of processes */
-Process *AddProcess(ProcessList *pList, pid_t PID, char *cmd, char nPipes, char isBG, int *fd);   
+void CompleteChain (Job *J);                                                          /* Prints '+ completed' messages for chains       */
+void CheckCompletedProcesses(ProcessList *pList);                                     /* Report and remove completed jobs               */
+char MarkProcessDone(ProcessList *pList, pid_t PID, int status, struct rusage *ru);   /* Mark process with matching PID as completed    */
+Process *FindProcess(ProcessList *pList, pid_t PID);                                  /* Running stage with matching PID, or NULL       */
+void ReadStageIO(Process *Me);                                                        /* Byte counts from /proc/<pid>/io, before reaping*/
+void TimeJob(ProcessList *pList, Job *J);                                             /* Report the job's resource usage when it ends   */
+void StageDone(ProcessList *pList, Process *Me, int status);                          /* Mark a stage as completed, queue finished jobs */
+void StageStopped(ProcessList *pList, pid_t PID, char stopped);                       /* Mark a stage as stopped, or continued          */
+void AddProcess(ProcessList *pList, Process *Me, pid_t PID);                          /* Hash a launched stage by its PID               */
+void RemoveJob(ProcessList *pList, Job *J);                                           /* Unlink a job from the table, free its arena    */
+/* Constructor - Add a job and its array of stages to the table */
+Job *AddJob(ProcessList *pList, Arena *A, char *cmd, int nPipes, int nRelays, char isBG, int *fd);
 /* **************************************************** */
 
 #endif
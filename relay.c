@@ -0,0 +1,211 @@
+#define _GNU_SOURCE                                     /* tee() and splice()                       */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"                                     /* fd names                                 */
+#include "history.h"                                    /* History structures, needed by sshell.h   */
+#include "sshell.h"                                     /* OpenMe() and WMODE                       */
+#include "relay.h"                                      /* Relay structures and prototypes          */
+
+/* **************************************************** */
+/* Opens the rest of a fanned out stage's '>' files and */
+/* the pipe it writes to instead. fd[1] holds the first */
+/* '>' file, Redirect() opened it, and becomes the      */
+/* pipe's write end. next is the write end of the pipe  */
+/* to the next stage, -1 for the last stage, and is the */
+/* last sink. Everything is closed again if a file or   */
+/* the pipe can't be opened.                            */
+/* Returns 0 if good, 1 if something won't open         */
+/* **************************************************** */
+char OpenRelay(Relay *R, Stage *S, int *fd, int next, Arena *A)
+{
+    int link[2];
+    int i;
+    char failed = 0;
+
+    R->in = -1;
+    R->sink = (int *) ArenaAlloc(A, (S->nTee + 2) * sizeof(int));
+    R->nSinks = 0;
+    R->sink[R->nSinks++] = fd[1];                       /* First '>' file                           */
+    for (i = 0; !failed && (i < S->nTee); i++)          /* The others, in order                     */
+        if ((R->sink[R->nSinks] = OpenMe(S->teeFile[i], WMODE)) == -1) failed = 1;
+        else R->nSinks++;
+    if (next != -1) R->sink[R->nSinks++] = next;        /* Pipe last, the relay blocks on it alone  */
+
+    if (!failed && (pipe2(link, O_CLOEXEC) == -1)) {
+        perror("pipe");
+        failed = 1;
+    }
+    if (failed) {                                       /* Don't leak what did open                 */
+        CloseRelay(R);
+        fd[1] = SO;
+        return 1;
+    }
+    R->in = link[0];                                    /* Relay reads what the stage writes        */
+    fd[1] = link[1];
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Closes the relay's fds, once it has its own copies   */
+/* **************************************************** */
+void CloseRelay(Relay *R)
+{
+    int i;
+    if (R->in != -1) close(R->in);
+    for (i = 0; i < R->nSinks; i++)
+        if (R->sink[i] != -1) close(R->sink[i]);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Moves len bytes out of the pipe from to the sink. It */
+/* is done with splice(), so the kernel hands the pipe  */
+/* buffers over and nothing is copied through here. A   */
+/* sink splice() can't write to gets read() and write() */
+/* instead. A sink that fails is closed and set to -1,  */
+/* and the bytes are still taken out of the pipe.       */
+/* Returns 1 if the sink failed, 0 otherwise            */
+/* **************************************************** */
+static char Move(int from, int *to, size_t len)
+{
+    static char buf[RELAY_COPY];
+    char copy = 0, dead = (*to == -1);
+    ssize_t got, put, off;
+
+    while (len) {
+        if (!dead && !copy) {
+            got = splice(from, NULL, *to, NULL, len, SPLICE_F_MOVE);
+            if (got > 0) len -= got;
+            else if ((got == -1) && (errno == EINVAL)) copy = 1; /* e.g. an O_APPEND file  */
+            else if ((got == -1) && (errno != EINTR)) dead = 1;
+            continue;
+        }
+        if ((got = read(from, buf, (len < RELAY_COPY) ? len : RELAY_COPY)) <= 0) {
+            if ((got == -1) && (errno == EINTR)) continue;
+            break;                                      /* Nothing left to take out                 */
+        }
+        len -= got;
+        for (off = 0; !dead && (off < got); off += put)
+            if ((put = write(*to, buf + off, got - off)) <= 0) dead = 1;
+    }
+    if (!dead || (*to == -1)) return 0;
+    perror("relay");                                    /* Disk full, for instance                  */
+    close(*to);
+    *to = -1;
+    return 1;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Takes up to len bytes out of the pipe from into buf. */
+/* Returns the number taken, less only at its end.      */
+/* **************************************************** */
+static size_t Take(int from, char *buf, size_t len)
+{
+    size_t n = 0;
+    ssize_t got;
+
+    while (n < len)
+        if ((got = read(from, buf + n, len - n)) > 0) n += got;
+        else if ((got == 0) || (errno != EINTR)) break;
+    return n;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Writes len bytes of buf to a sink. A sink that fails */
+/* is closed and set to -1, as in Move().               */
+/* Returns 1 if the sink failed, 0 otherwise            */
+/* **************************************************** */
+static char Put(int *to, const char *buf, size_t len)
+{
+    ssize_t put;
+
+    while ((*to != -1) && len)
+        if ((put = write(*to, buf, len)) > 0) {
+            buf += put;
+            len -= put;
+        } else if ((put == -1) && (errno == EINTR)) continue;
+        else {
+            perror("relay");
+            close(*to);
+            *to = -1;
+            return 1;
+        }
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Ends a round whose tee() for sink first copied only  */
+/* teed of its len bytes. tee() always starts at the    */
+/* front of the pipe, so the rest can't be teed on its  */
+/* own. The partial copy is dropped, and the round is   */
+/* taken out of the stage's pipe and written to that    */
+/* sink and all after it.                               */
+/* Returns 1 if a sink failed, 0 otherwise              */
+/* **************************************************** */
+static char CopyRound(Relay *R, int scratch, size_t teed, int first, size_t len)
+{
+    static char buf[RELAY_CHUNK];
+    char failed = 0;
+    int i;
+
+    Take(scratch, buf, teed);                           /* Empties the scratch pipe again           */
+    len = Take(R->in, buf, len);
+    for (i = first; i < R->nSinks; i++)
+        failed |= Put(&R->sink[i], buf, len);
+    return failed;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs in the relay's process until the stage closes   */
+/* its output. Each round tee() duplicates what is in   */
+/* the pipe into a scratch pipe without taking it out,  */
+/* and the scratch pipe is spliced to one sink, for all */
+/* sinks but the last. The last one gets the bytes      */
+/* spliced out of the stage's pipe itself, which makes  */
+/* room for the next round. The data never leaves the   */
+/* kernel. A pipe sink whose reader is gone ends the    */
+/* relay with SIGPIPE, as it does /usr/bin/tee. If a    */
+/* later tee() copies less than the first, the round is */
+/* finished by CopyRound() instead.                     */
+/* Returns the relay's exit status, 1 if a sink failed  */
+/* **************************************************** */
+int RunRelay(Relay *R)
+{
+    int scratch[2];
+    int i, last = R->nSinks - 1;
+    ssize_t got, teed;
+    char failed = 0, copied;
+
+    if (pipe(scratch) == -1) {
+        perror("pipe");
+        return 1;
+    }
+    while (1) {
+        got = tee(R->in, scratch[1], RELAY_CHUNK, 0);  /* Sleeps until the stage writes            */
+        if ((got == -1) && (errno == EINTR)) continue;
+        if (got <= 0) break;                            /* 0 once the stage has closed its end      */
+
+        for (copied = 0, i = 0; !copied && (i < last); i++) {
+            if (i) {                                    /* Same bytes again for this sink           */
+                while (((teed = tee(R->in, scratch[1], got, 0)) == -1) && (errno == EINTR));
+                if (teed < got) {                       /* Short, the rest can't be teed            */
+                    failed |= CopyRound(R, scratch[0], (teed > 0) ? teed : 0, i, got);
+                    copied = 1;                         /* Consumed the round                       */
+                    continue;
+                }
+            }
+            failed |= Move(scratch[0], &R->sink[i], got);
+        }
+        if (!copied) failed |= Move(R->in, &R->sink[last], got); /* Consumes the round          */
+    }
+    if (got == -1) {
+        perror("tee");
+        failed = 1;
+    }
+    return failed;
+}
+/* **************************************************** */
@@ -0,0 +1,27 @@
+#ifndef _RELAY_H
+#define _RELAY_H
+
+#include "parse.h"                                      /* The stage's '>' files                            */
+
+/* **************************************************** */
+/*                   Relay Structures                   */
+/* **************************************************** */
+#define RELAY_CHUNK 65536                               /* Bytes tee()d per round, what a pipe holds        */
+#define RELAY_COPY  4096                                /* Buffer for sinks splice() can't write to         */
+
+typedef struct Relay {                                  /* Fans one stage's output out to several sinks     */
+    int in;                                             /* Read end of the pipe the stage writes to         */
+    int nSinks;                                         /* Number of sinks                                  */
+    int *sink;                                          /* '>' files in order, then the next stage's pipe   */
+} Relay;
+/* **************************************************** */
+
+/* **************************************************** */
+/*                   Relay Functions                    */
+/* **************************************************** */
+char OpenRelay(Relay *R, Stage *S, int *fd, int next, Arena *A); /* Sinks and the stage's pipe, 1 if failed */
+void CloseRelay(Relay *R);                              /* Closes the shell's copies of the relay's fds     */
+int RunRelay(Relay *R);                                 /* Moves everything to every sink, in the relay     */
+/* **************************************************** */
+
+#endif
@@ -1,10 +1,17 @@
+#define _GNU_SOURCE                                     /* posix_spawn_file_actions_addtcsetpgrp_np()     */
+                                                        /* and memfd_create()                             */
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <spawn.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 
@@ -19,17 +26,268 @@
 #include "history.h"                                    /* History structures and related functions       */
 #include "noncanmode.h"                                 /* Slightly modifiedd version of Joel's file      */
 #include "sshell.h"                                     /* Function prototypes for sshell.c functions     */
+#include "batch.h"                                      /* Non-interactive script execution               */
+#include "parse.h"                                      /* Single pass command line parser                */
+#include "hash.h"                                       /* Executable lookup cache                        */
+#include "builtin.h"                                    /* Utilities run without a process                */
+#include "complete.h"                                   /* TAB completion                                 */
+#include "parallel.h"                                   /* Fans a command out over many arguments         */
+#include "jobs.h"                                       /* Process groups, fg, bg, jobs, wait and kill    */
+#include "trace.h"                                      /* Chrome trace-event spans, $SSHELL_TRACE        */
+#include "relay.h"                                      /* Fans a stage's output out to several '>' files */
+#include "subst.h"                                      /* $(...) command substitution                    */
+#include "env.h"                                        /* Shell variables and the cached environment     */
 /* **************************************************** */
+extern char **environ;                                  /* Environment handed to spawned programs         */
+static sigset_t childMask;                              /* Signal mask children start with                */
+static sigset_t routed;                                 /* Signals read from childFd, never delivered     */
+static int childFd = -1;                                /* signalfd() that reports SIGCHLD, and SIGINT    */
+static char interrupted;                                /* Ctrl-C came while the shell had the terminal   */
+static char interactive;                                /* 1 once the keyboard loop owns STDIN            */
+static char typeAhead[LINE_STACK];                      /* Keys typed while a foreground job ran          */
+static int typeStart, typeEnd;                          /* Unread part of typeAhead                       */
+static MoreFn hereMore;                                 /* Where '<<' bodies come from, NULL for nowhere  */
+static void *hereCtx;                                   /* Handed back to hereMore                        */
 /* **************************************************** */
-/* SIGCHDL Signal Handler                               */
 /* **************************************************** */
-static void ChildSignalHandler(int signum)
+/* Reaps every child that has ended. SIGCHLD is always  */
+/* blocked and only read from childFd, so this is the   */
+/* only place the job table is changed by a child.      */
+/* Stages that stop or continue are marked too, and a   */
+/* stage killed by a signal gets 128 + the signal as    */
+/* its status. A Ctrl-C read from childFd is noted for  */
+/* Interrupted().                                       */
+/* **************************************************** */
+static void ReapChildren(void)
 {
-    pid_t PID;
+    struct signalfd_siginfo info;
+    struct rusage ru;                                   /* What the child used, from wait4()              */
+    siginfo_t peek;
+    Process *Me;
+    pid_t PID = -1;
     int status;
 
-    while ((PID = waitpid(-1, &status, WNOHANG)) > 0)   /* Allow many child proccesses to end if needed   */
-        MarkProcessDone(processList,PID,xStat(status)); /* Mark the process as completed                  */
+    TRACE_BEGIN("reap", NULL);
+    while (read(childFd, &info, sizeof(info)) > 0)      /* Drain, several exits may share one signal      */
+        if (info.ssi_signo == SIGINT) interrupted = 1;
+    while (1) {                                         /* Allow many child proccesses to end if needed   */
+        if (processList->timing) {                      /* /proc/<pid>/io is gone once it's reaped        */
+            peek.si_pid = 0;
+            if (waitid(P_ALL, 0, &peek, WEXITED | WSTOPPED | WCONTINUED | WNOHANG | WNOWAIT) || !peek.si_pid) break;
+            PID = peek.si_pid;
+            if ((peek.si_code != CLD_STOPPED) && (peek.si_code != CLD_CONTINUED) &&
+                ((Me = FindProcess(processList, PID)) != NULL) && Me->job->timeMe)
+                ReadStageIO(Me);
+        }
+        if ((PID = wait4(PID, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) <= 0) break;
+        if (WIFSTOPPED(status))                         /* Ctrl-Z, SIGSTOP, or tty access from the bg     */
+            StageStopped(processList, PID, 1);
+        else if (WIFCONTINUED(status))
+            StageStopped(processList, PID, 0);
+        else                                            /* Mark the process as completed                  */
+            MarkProcessDone(processList, PID, WIFSIGNALED(status) ? 128 + WTERMSIG(status) : xStat(status), &ru);
+        PID = -1;
+    }
+    TRACE_END(0);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Sleeps until a child ends, the shell gets CTRL+C, or */
+/* fd can be read without blocking. fd is ignored if it */
+/* is -1. Ended children are reaped before it returns.  */
+/* Returns 1 if fd is readable, or at its end.          */
+/* **************************************************** */
+char WaitInput(int fd)
+{
+    struct pollfd fds[2] = {{childFd, POLLIN, 0}, {fd, POLLIN, 0}};
+
+    FlushOut();                                         /* Nothing is left queued while blocked           */
+    while (poll(fds, (fd != -1) ? 2 : 1, -1) == -1)     /* Block until one of them is ready               */
+        if (errno != EINTR) return 0;
+    if (fds[0].revents) ReapChildren();                 /* A child ended                                  */
+    return (fd != -1) && fds[1].revents;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Sleeps until a child ends or, if keys is set, until  */
+/* a key is typed. Ended children are reaped before it  */
+/* returns. Returns 1 if a key is waiting on STDIN.     */
+/* **************************************************** */
+char WaitEvent(char keys)
+{
+    return WaitInput(keys ? SI : -1);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns 1 once for each Ctrl-C typed while the shell */
+/* had the terminal, 0 otherwise                        */
+/* **************************************************** */
+char Interrupted(void)
+{
+    char was = interrupted;
+    interrupted = 0;
+    return was;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Prints '+ completed' messages for jobs that ended    */
+/* while the prompt was showing, then redraws the line  */
+/* the user was typing.                                 */
+/* **************************************************** */
+static void NotifyJobs(Editor *E)
+{
+    if (processList->doneTop == NULL) return;           /* Nothing finished, leave the line alone         */
+    LeaveLine(E);                                       /* Below all of a wrapped line                    */
+    PrintNL();
+    CheckCompletedProcesses(processList);               /* Report the finished jobs                       */
+    DisplayPrompt();                                    /* Redraw the prompt                              */
+    RedrawLine(E);                                      /* and whatever was typed so far                  */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns the next keystroke. Type-ahead saved during  */
+/* a foreground job comes first. Jobs that finish while */
+/* waiting for a key are reported right away, and a     */
+/* Ctrl-C comes back as CTRL_C.                         */
+/* **************************************************** */
+char NextKey(Editor *E)
+{
+    if (typeStart < typeEnd)                            /* Replay type-ahead first                        */
+        return typeAhead[typeStart++];
+    typeStart = typeEnd = 0;
+
+    while (!WaitEvent(TRUE)) {                          /* A child ended before a key came                */
+        if (Interrupted()) return CTRL_C;
+        NotifyJobs(E);
+    }
+    return Get1Char();
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Ctrl-R incremental reverse search. Each key typed    */
+/* narrows the query and shows the newest command that  */
+/* holds it, and Ctrl-R again steps to an older match.  */
+/* Any other key ends the search with the match left on */
+/* the command line. That key is returned so the main   */
+/* loop handles it as usual, and RETURN runs the match. */
+/* **************************************************** */
+char ReverseSearch(History *history, Editor *E)
+{
+    char query[LINE_STACK];                             /* Search string typed so far                     */
+    int qLen = 0;
+    uint64_t none = history->file->head;                /* Sequence number meaning no match               */
+    uint64_t found = none, seq;
+    const char *text = NULL;
+    size_t len = 0;
+    char key, failed = 0;
+    const char *label;
+
+    MoveCursor(E, 0);                                   /* Search line starts where the prompt is         */
+    RefreshLine(E);
+    while (1) {
+        label = failed ? "\r\033[J(failed reverse-i-search)`" : "\r\033[J(reverse-i-search)`";
+        Emit(SO, label, strlen(label));                 /* Redraw the search line, one write at the flush */
+        Emit(SO, query, qLen);
+        Emit(SO, "': ", 3);
+        if (text != NULL) Emit(SO, text, len);
+
+        key = NextKey(E);
+        if (key == CTRL_R)                              /* Next older match                               */
+            seq = found;
+        else if (key == BACKSPACE) {                    /* Shorter query, start over from the newest      */
+            if (qLen) qLen--;
+            else ErrorBell();
+            seq = none;
+        } else if (isprint((unsigned char) key)) {      /* Longer query, the current match may still fit  */
+            if (qLen < LINE_STACK) query[qLen++] = key;
+            else ErrorBell();
+            seq = found + 1;
+        } else
+            break;                                      /* Search is over                                 */
+
+        if (!qLen) {                                    /* Nothing to look for                            */
+            found = none;
+            failed = 0;
+        } else if (SearchHistory(history, query, qLen, &seq)) {
+            found = seq;
+            failed = 0;
+        } else
+            failed = 1;                                 /* Keep showing the last match                    */
+        text = (found != none) ? HistoryEntry(history, found, &len) : NULL;
+    }
+
+    Emit(SO, "\r\033[K", 4);                           /* Back to the normal prompt                      */
+    DisplayPrompt();
+    if (text != NULL) SetLine(E, text, len);            /* Put the match on the command line              */
+    RedrawLine(E);
+    return key;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Handles keys sent as ESC sequences: the arrows, HOME */
+/* END and DELETE, plus word moves with Ctrl-LEFT and   */
+/* Ctrl-RIGHT (ESC [ 1 ; 5 D/C) or Alt-b and Alt-f.     */
+/* Sequences it doesn't know are dropped.               */
+/* **************************************************** */
+void EscapeKey(History *history, Editor *E)
+{
+    char key = NextKey(E), param[8];
+    size_t n = 0;
+    char done = 1, word;
+
+    if ((key == 'b') || (key == 'f')) {                 /* Alt-b, Alt-f                                   */
+        done = MoveCursor(E, (key == 'b') ? WordLeft(E) : WordRight(E));
+        if (!done) ErrorBell();
+        return;
+    }
+    if (key == SS3)                                     /* ESC O H, ESC O F                               */
+        key = NextKey(E);
+    else if (key == ARROW) {                            /* ESC [ params final                             */
+        while ((((key = NextKey(E)) >= '0') && (key <= '9')) || (key == ';'))
+            if (n < sizeof(param) - 1) param[n++] = key;
+    } else
+        return;
+    param[n] = '\0';
+    word = !strcmp(param, "1;5") || !strcmp(param, "1;3");  /* Ctrl or Alt held down                     */
+
+    switch (key) {
+        case UP:                                        /*     UP      */
+            if (history != NULL) DisplayNextEntry(history, E);
+            else done = 0;                              /* No history for here-document lines             */
+            break;
+        case DOWN:                                      /*    DOWN     */
+            if (history != NULL) DisplayPrevEntry(history, E);
+            else done = 0;
+            break;
+        case LEFT:                                      /*    LEFT     */
+            done = word ? MoveCursor(E, WordLeft(E)) : (E->gapStart && MoveCursor(E, E->gapStart - 1));
+            break;
+        case RIGHT:                                     /*    RIGHT    */
+            done = MoveCursor(E, word ? WordRight(E) : E->gapStart + 1);
+            break;
+        case HOME:                                      /*    HOME     */
+            done = MoveCursor(E, 0);
+            break;
+        case END:                                       /*     END     */
+            done = MoveCursor(E, LineLength(E));
+            break;
+        case '~':                                       /* ESC [ n ~, the VT220 keys                      */
+            if (!strcmp(param, "1") || !strcmp(param, "7")) done = MoveCursor(E, 0);
+            else if (!strcmp(param, "4") || !strcmp(param, "8")) done = MoveCursor(E, LineLength(E));
+            else if (!strcmp(param, "3")) done = DeleteForward(E);
+            break;
+    }
+    if (!done) ErrorBell();
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Saves keys typed while a foreground job runs, so     */
+/* they are handled once the prompt is back.            */
+/* **************************************************** */
+static void SaveTypeAhead(void)
+{
+    ssize_t got = read(SI, typeAhead + typeEnd, LINE_STACK - typeEnd);
+    if (got > 0) typeEnd += got;
 }
 /* **************************************************** */
 /* **************************************************** */
@@ -47,90 +305,69 @@ char ChangeDir(char *args[])
 /* **************************************************** */
 /* Print Working Directory  (pwd)                       */
 /* **************************************************** */
-char PrintWDir(char *args[])
+char PrintWDir(Stage *S)
 {
-    char workingDir[MAX_BUFFER];
-    int fd;                                             /* File descriptor                          */
-    getcwd(workingDir, MAX_BUFFER);                     /* Write working directory into workingDir  */
-    sprintf(workingDir, "%s\n", workingDir);            /* Add a new line character                 */
-   
-    if ((args[1] == NULL || *args[1] != '>')) {         /* If no redirect args, write to STDOUT     */
-        write(SO, workingDir, strlen(workingDir));      /* Write the working directory to STDOUT    */
-        return 0;
-    }
+    char workingDir[PATH_MAX + 1];                      /* +1 for the new line character            */
+    int fd = SO, len;                                   /* File descriptor                          */
+    getcwd(workingDir, PATH_MAX);                       /* Write working directory into workingDir  */
+    len = strlen(workingDir);
+    workingDir[len++] = '\n';                           /* Add a new line character                 */
 
-    if ((*args[1] == '>') && (args[2] != NULL)) {       /* If the first argument is '>', set out fd */
-        fd = OpenMe(args[2], WMODE);                    /* Open a file for writing                  */
-        write(fd, workingDir, strlen(workingDir));      /* Write the working directory to file      */
-        return 0;
-
-    } else {
-        NoOutputFile();                                 /* Error: no output file message            */
-        return 1;
-    }
+    if (S->outFile != NULL)                             /* If output redirect, open the file        */
+        if ((fd = OpenMe(S->outFile, WMODE)) == -1)     /* Open for writing, OpenMe() reports errors */
+            return 1;
+    write(fd, workingDir, len);                         /* Write the working directory              */
+    if (fd != SO) close(fd);
+    return 0;
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Breaks up a command into a NULL terminated array.    */
-/*                                                      */
-/* cmd = "ls -l -a" returns {"ls","-l","-a", NULL};     */
+/* Lists or clears the executable lookup cache (hash)   */
+/* 'hash' lists it, 'hash -r' empties it, and           */
+/* 'hash name...' looks the names up ahead of time.     */
 /* **************************************************** */
-char **Cmd2Array(char *cmd)
+char HashPaths(Stage *S)
 {
-    char **args =  (char **) malloc(MAX_TOKENS * sizeof(char*));
-    unsigned int i = 0;
-    cmd = RemoveWhitespace(cmd);                        /* Remove leading/trailing whitespace                   */
-    char *space = strchr(cmd, ' ');                     /* space points to the first occurance of ' ' in cmd    */
-    
-    while(space != NULL) {                              /* Repeat until no more ' ' found                       */
-        *space = '\0';                                  /* Replace ' ' with '\0' to terminate the string        */
-        args[i] = (char *) malloc(strlen(cmd)+1);       /* Allocate space for the cmd string                    */
-        args[i++] = cmd;                                /* Put null terminated string into the arguments array  */
-        cmd = RemoveWhitespace(space + 1);              /* Remove leading/trailing whitespace in remaining cmd  */
-        space = strchr(cmd, ' ');                       /* space points to the first place ' ' occurs in cmd    */
-    }
-    
-    if (*cmd != '\0') {                                 /* If no more spaces, but still not at the end of cmd   */
-        args[i] = (char *)malloc(strlen(cmd)+1);        /* Allocate space for the remaining portion of cmd      */
-        args[i++] = cmd;
-    }
+    int fd = SO, i;                                     /* File descriptor                          */
+    char failed = 0;
+
+    if (S->outFile != NULL)                             /* If output redirect, open the file        */
+        if ((fd = OpenMe(S->outFile, WMODE)) == -1)
+            return 1;
 
-    args[i] = (char *) malloc(sizeof(char*));           /* Allocate space for the NULL character (Not needed?)  */
-    args[i] = NULL;
-    return args;
+    if (S->argc == 1)                                   /* No arguments, list the cache             */
+        ListPaths(fd);
+    else if (!strcmp(S->argv[1], "-r"))                 /* Forget every cached path                 */
+        ClearPaths();
+    else for (i = 1; i < S->argc; i++)                  /* Resolve each name now                    */
+        if (LookupPath(S->argv[i]) == NULL) {
+            ThrowError("Error: command not found");
+            failed = 1;
+        }
+
+    if (fd != SO) close(fd);
+    return failed;
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Breaks up  a command into dynamically allocated      */
-/* 2D array of command pointers.                        */
-/*                     Example  1                       */
-/* "ls -la|grep filename" -> {args0, args1, NULL}       */
-/* where args0 = {"ls", "-la", NULL}                    */
-/* where args1 = {"grep", "filename", NUll}             */
-/*                     Example  2                       */
-/* "ls -la>outfile" -> {args0, NULL}                    */
-/* where args0 = {"ls", "-la", ">", "outfile", NULL}    */
+/* Lists or exports environment variables (export)      */
+/* 'export' lists them, 'export NAME[=value]...'        */
+/* exports the names.                                   */
 /* **************************************************** */
-char ***Pipes2Arrays(char *cmd, char *numPipes)
+char ExportEnv(Stage *S)
 {
-    unsigned int i = 0;
-    char ***pipes =  (char ***) malloc(MAX_TOKENS * sizeof(char**));
-    cmd = RemoveWhitespace(cmd);                        /* Remove leading/trailing whitespace                   */
-    char *bar = strchr(cmd, '|');                       /* bar points to the first occurance of '|' in cmd      */
-    
-    while(bar != NULL) {                                /* Repeat until no more '|'                             */
-        *bar = '\0';                                    /* Replace '|' with '\0                                 */
-        pipes[i++] = Cmd2Array(cmd);                    /* Put the cmd array into the pipes array               */
-        cmd = RemoveWhitespace(bar+1);                  /* Remove leading/trailing whitespace for rest command  */
-        bar = strchr(cmd, '|');                         /* bar points to the first occurance of '|' in cmd      */
-    }      
-    
-    if (*cmd != '\0')                                   /* If there are still characters in cmd                 */
-        pipes[i++] = Cmd2Array(cmd);                    /* Add them to the array                                */
-         
-    pipes[i] = NULL;                                    /* Set the last entry to be NULL                        */
-    *numPipes = i;                                      /* Number of Pipes in commmand + 1                      */
-    return pipes;                                       /* Return the pointer                                   */
+    int fd = SO;                                        /* File descriptor                          */
+    char failed = 0;
+
+    if (S->outFile != NULL)                             /* If output redirect, open the file        */
+        if ((fd = OpenMe(S->outFile, WMODE)) == -1)
+            return 1;
+
+    if (S->argc == 1) ListVars(fd);                     /* No arguments, list them                  */
+    else failed = ExportVars(S->argv);
+
+    if (fd != SO) close(fd);
+    return failed;
 }
 /* **************************************************** */
 /* **************************************************** */
@@ -139,34 +376,177 @@ char ***Pipes2Arrays(char *cmd, char *numPipes)
 /* **************************************************** */
 void RunMe(char *cmds[], Process *Me)
 {
+    JoinJob(Me);                                        /* Own process group, default signals    */
+    sigprocmask(SIG_SETMASK, &childMask, NULL);         /* Don't inherit the launch-time mask    */
     Dup2AndClose(Me->fd[0], STDIN_FILENO);              /* Read from fd[0]                       */
     Dup2AndClose(Me->fd[1], STDOUT_FILENO);             /* Write  to fd[1]                       */
+    if (Me->envp != NULL) environ = Me->envp;           /* The stage's NAME=value words          */
     execvp(cmds[0], cmds);                              /* Execute command                       */
     perror("execvp");                                   /* Report an error if code gets here     */
     exit(EXIT_FAILURE);                                 /* Exit with  failure                    */
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Executes blocking or nonblocking waitpid()           */
+/* Returns the PATH a stage set with its own PATH=value */
+/* word, NULL if it searches the shell's PATH.          */
+/* **************************************************** */
+static const char *StagePATH(char **envp)
+{
+    const char *PATH = getenv("PATH");
+    for (; (envp != NULL) && (*envp != NULL); envp++)
+        if (!strncmp(*envp, "PATH=", 5))
+            return ((PATH != NULL) && !strcmp(*envp + 5, PATH)) ? NULL : *envp + 5;
+    return NULL;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Launches a single stage with posix_spawn(). The      */
+/* redirects are applied as file actions, so the shell  */
+/* never copies its page tables the way fork() does.    */
+/* The program's path comes from the lookup cache, so   */
+/* PATH isn't walked on every launch. A cached path     */
+/* that stopped working is dropped, and posix_spawnp()  */
+/* walks PATH instead. A stage with its own PATH=value  */
+/* is looked up in that PATH, bypassing the cache, as   */
+/* posix_spawnp() would search the shell's.             */
+/* Under job control the stage joins its job's process  */
+/* group, the first stage of a foreground job takes the */
+/* terminal before it execs, and the signals the shell  */
+/* ignores are reset to their defaults.                 */
+/* The environment is the shell's cached one, or the    */
+/* stage's own if it has NAME=value words.              */
+/* Returns 0, or the error code posix_spawn() gave.     */
+/* **************************************************** */
+int SpawnMe(char *cmds[], Process *Me)
+{
+    int err = ENOENT;
+    char **envp = (Me->envp != NULL) ? Me->envp : environ;
+    const char *PATH = StagePATH(Me->envp);             /* 'PATH=/x cmd' searches /x only        */
+    char *own = NULL, *path;
+    posix_spawn_file_actions_t acts;                    /* dup2()/close() run in the new process */
+    posix_spawnattr_t attr;                             /* Signal mask the new process starts w/ */
+    short flags = POSIX_SPAWN_SETSIGMASK;
+
+    if (PATH == NULL) path = LookupPath(cmds[0]);       /* NULL if execvp() has to search for it */
+    else if (strchr(cmds[0], '/') == NULL) path = own = SearchPath(cmds[0], PATH); /* Not cached   */
+    else path = cmds[0];                                /* Not searched at all                   */
+
+    posix_spawn_file_actions_init(&acts);
+    posix_spawnattr_init(&attr);
+    if (jobControl) {
+        posix_spawnattr_setpgroup(&attr, Me->job->pgid);/* 0 makes this stage the group leader   */
+        posix_spawnattr_setsigdefault(&attr, &jobSignals);
+        flags |= POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF;
+        if (!Me->job->isBG && !Me->job->pgid)           /* Before the redirects replace STDIN    */
+            posix_spawn_file_actions_addtcsetpgrp_np(&acts, SI);
+    }
+    if (Me->fd[0] != SI) {                              /* Read from fd[0]                       */
+        posix_spawn_file_actions_adddup2(&acts, Me->fd[0], SI);
+        posix_spawn_file_actions_addclose(&acts, Me->fd[0]);
+    }
+    if (Me->fd[1] != SO) {                              /* Write to fd[1]                        */
+        posix_spawn_file_actions_adddup2(&acts, Me->fd[1], SO);
+        posix_spawn_file_actions_addclose(&acts, Me->fd[1]);
+    }
+    posix_spawnattr_setsigmask(&attr, &childMask);      /* Don't inherit the launch-time mask    */
+    posix_spawnattr_setflags(&attr, flags);
+
+    if (path != NULL)                                   /* Cached, execve() it directly          */
+        err = posix_spawn(&Me->PID, path, &acts, &attr, cmds, envp);
+    if ((PATH == NULL) && ((err == ENOENT) || (err == ENOTDIR) || (err == EACCES))) {
+        if (path != NULL) ForgetPath(cmds[0]);          /* Moved or removed since it was cached  */
+        err = posix_spawnp(&Me->PID, cmds[0], &acts, &attr, cmds, envp);
+    }
+    free(own);                                          /* Only a stage's own PATH allocates one */
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&acts);
+    return err;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Launches a single stage. posix_spawnp() is used      */
+/* unless the stage needs something only fork() can do: */
+/* scripts without a #! line are run through /bin/sh by */
+/* execvp(), but are refused by posix_spawnp().         */
+/* The first stage started names the job's group.       */
 /* **************************************************** */
-void Wait4Me(Process *Me)
+void LaunchMe(char *cmds[], Process *Me)
 {
+    Job *J = Me->job;
+    int err;
+
+    TRACE_BEGIN("launch", cmds[0]);
+    FlushOut();                                         /* The child may write to the terminal   */
+    err = SpawnMe(cmds, Me);                            /* Try the cheap path first              */
+    if (err == ENOEXEC) {                               /* Needs execvp()'s /bin/sh fallback     */
+        ForkMe(cmds, Me);                               /* Fork, exec & close                    */
+        err = 0;
+    } else {
+        if (Me->fd[0] != SI) close(Me->fd[0]);          /* Parent closes the read pipes          */
+        if (Me->fd[1] != SO) close(Me->fd[1]);          /* Parent closes the write pipe          */
+    }
+
+    if (err) {                                          /* Program could not be started          */
+        errno = err;                                    /* Same message the child would print    */
+        perror("execvp");
+        StageDone(processList, Me, EXIT_FAILURE);       /* Same status the child would exit with */
+        TRACE_END(0);
+        return;
+    }
+    AddProcess(processList, Me, Me->PID);               /* Let the handler find it by PID        */
+    if (jobControl && !J->pgid) {                       /* Leader of the job's process group     */
+        J->pgid = Me->PID;
+        if (!J->isBG) SetForeground(J);                 /* The child takes it too, whoever's 1st */
+    }
+    TRACE_END(Me->PID);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Waits for every stage of a chain to complete. Other  */
+/* jobs that end meanwhile are reported right away.     */
+/* Keys typed meanwhile are saved, unless the chain     */
+/* reads from the terminal itself. Under job control    */
+/* the terminal queues them instead, since the shell    */
+/* can't read it while the chain has it.                */
+/* A chain that is stopped, e.g. by Ctrl-Z, is left in  */
+/* the background. Returns the last stage's status, or  */
+/* 148 if the chain was stopped.                        */
+/* **************************************************** */
+int Wait4Me(Job *J)
+{
+    char done, keys;
     int status;
-    if (Me->isBG) {                                     /* If it's to be run in background       */
-        waitpid(Me->PID, &status, WNOHANG);             /* Use non-blocking call to waitpid      */
-        Me->status = xStat(status);                     /* Set the temporary status              */
-    } else {                                            /* Otherwise                             */
-        waitpid(Me->PID, &status, 0);                   /* wait for child to exit                */
-        MarkProcessDone(processList, Me->PID, xStat(status));
+    if (J->isBG) return 0;                              /* Background chains are reported later    */
+
+    keys = interactive && !jobControl && (J->stage[0].fd[0] != SI); /* Don't steal the chain's input */
+    while (1) {
+        if (JobStopped(J)) {                            /* Stays in the table until 'fg' or 'bg'   */
+            J->isBG = 1;
+            SetForeground(NULL);
+            PrintJob(SE, J);
+            CheckCompletedProcesses(processList);
+            return JOB_STOPPED;
+        }
+        done = !J->nRunning;                            /* Read before J can be freed              */
+        status = J->stage[J->nPipes - 1].status;
+        CheckCompletedProcesses(processList);           /* Report whatever has finished            */
+        if (done) {
+            SetForeground(NULL);                        /* The terminal comes back to the shell    */
+            return status;
+        }
+        if (WaitEvent(keys && typeEnd < LINE_STACK))    /* Sleep until a child ends or a key comes */
+            SaveTypeAhead();
     }
 }
 /* **************************************************** */
 /* **************************************************** */
-/* ForkMe() - Forks a process .Child runs, parent waits */
+/* ForkMe() - Forks a process. Child runs, parent       */
+/* returns right away so the next stage can be forked.  */
 /* Also my thought contents during quizzes.             */
 /* **************************************************** */
 void ForkMe(char *cmds[], Process *Me)
 {
+    TRACE_BEGIN("fork", NULL);
     Me->PID = fork();                                   /* Fork the process, set the PID         */
     switch(Me->PID) {                                   /* Switch statemnt on PID                */
         case -1:                                        /* -1 means fork() failed                */
@@ -175,10 +555,12 @@ void ForkMe(char *cmds[], Process *Me)
         case 0:                                         /* Child Process                         */
             RunMe(cmds, Me);                            /* Execute the program                   */
         default:                                        /* Parent Process (PID > 0)              */
+            if (jobControl)                             /* As the child does, whoever runs first */
+                setpgid(Me->PID, Me->job->pgid ? Me->job->pgid : Me->PID);
             if (Me->fd[0] != SI) close(Me->fd[0]);      /* Parent closes the read pipes          */
             if (Me->fd[1] != SO) close(Me->fd[1]);      /* Parent closes the write pipe          */
-            Wait4Me(Me);                                /* Wait w/ blocking or non-blcoking      */
     }
+    TRACE_END(Me->PID);
 }
 /* **************************************************** */
 /* **************************************************** */
@@ -194,267 +576,559 @@ int OpenMe(const char *Me, const int Mode)
     return fd;
 }
 /* **************************************************** */
-
 /* **************************************************** */
-/* Execute program commands. Looped if they are piped   */
+/* Returns a read fd holding a here-document or '<<<'   */
+/* string, close-on-exec like the files OpenMe() opens. */
+/* Up to PIPE_BUF bytes go in a pipe, which takes them  */
+/* in one write() that can't block. Bigger bodies go in */
+/* a memfd_create() file read from its start. Neither   */
+/* touches the file system. -1 if it couldn't be made.  */
 /* **************************************************** */
-char ExecProgram(char **cmds[], Process *P)
+int OpenHere(const char *text, size_t len)
 {
-    Process *Me, *cP, *cP2;                             /* Pointers to process structures        */
-    int N = 0;                                          /* Pipe iterator                         */
-    int firstPipe[2];                                   /* FD for chaining pipes together        */
-    int secPipe[2];                                     /* FD for chaining pipes togetehr        */
-    int inPipe = STDIN_FILENO;                          /* Pointer that points to 1 of 2 pipes   */
-    Me = P;                                             /* Me points to the parent in the chain  */
-   
-    while ((cmds[N+1] != NULL) && cmds[N+2] != NULL) {  /* While pipes to chain together exist   */
-         cP = AddProcessAsChild(processList, Me, 1, "\0");
+    int fd[2], in;
+    ssize_t put;
 
-        /* Setup Pipes from P1 to P2 */
-        if (CheckRedirect(cmds, cP, N)) return 1;       /* Setup redirects, check against pipes  */
-        pipe(firstPipe);                                /* Create the Pipe                       */
-        cP->fd[1] = firstPipe[1];                       /* Child will write to the pipe          */
-        cP->fd[0] = inPipe;                             /* Get input from inPipe                 */
-        ForkMe(cmds[N++], cP);                          /* Fork the process, exec, close & wait  */
-        
-        /* Setup Pipes from P2 to P3 */
-        cP2 = AddProcessAsChild(processList, cP, 1, "\0");
-        if (CheckRedirect(cmds, cP2, N)) return 1;      /* Setup redirects, check against pipes  */
-        pipe(secPipe);                                  /* Create the Pipe                       */
-        cP2->fd[0] = firstPipe[0];                      /* Child will read from last pipe        */
-        cP2->fd[1] = secPipe[1];                        /* but will write to the next pipe       */
-        ForkMe(cmds[N++], cP2);                         /* Fork the process, exec, close & wait  */
-        Me = cP2;                                       /* Parent now becomes child process 2    */
-        inPipe = secPipe[0];                            /* inPipe points to secPipe[0] now       */
+    if (len <= PIPE_BUF) {                              /* Small, a pipe holds all of it            */
+        if (pipe2(fd, O_CLOEXEC) == -1) {
+            perror("pipe");
+            return -1;
+        }
+        if (len) put = write(fd[1], text, len);         /* Atomic, and the pipe is empty            */
+        close(fd[1]);                                   /* Reader sees EOF after the body           */
+        return fd[0];
     }
 
-    /* Only 2 commands to pipe left */ 
-    if (cmds[N+1] != NULL) {                                          
-        cP = AddProcessAsChild(processList, Me, 1, "\0");
-        if (CheckRedirect(cmds, cP, N)) return 1;       /* Setup redirects, check against pipes  */
-        pipe(firstPipe);                                /* Create the Pipe                       */
-        cP->fd[1] = firstPipe[1];                       /* Child will write to the pipe          */
-        cP->fd[0] = inPipe;                             /* Child reads from in pipe              */
-        ForkMe(cmds[N++], cP);                          /* Fork the process, exec program, wait  */
-        inPipe = firstPipe[0];                          /* inPipe points to firstPipe[0]         */
-    } 
-
-    /* Only 1 command to left to run  */
-    if (CheckRedirect(cmds, P, N)) return 1;            /* Setup redirects, check against pipes  */
-    if (N != 0)  P->fd[0] = inPipe;                     /* If last in a chain, get piped input   */
-    ForkMe(cmds[N], P);
+    if ((in = memfd_create("sshell-here", MFD_CLOEXEC)) == -1) {
+        perror("memfd_create");
+        return -1;
+    }
+    for (put = 0; len; text += put, len -= put)         /* Anonymous file, the size of the body     */
+        if ((put = write(in, text, len)) == -1) {
+            perror("write");
+            close(in);
+            return -1;
+        }
+    lseek(in, 0, SEEK_SET);                             /* Stage reads it from the start            */
+    return in;
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Starts the relay of a stage with several '>' files,  */
+/* right after the stage. It is a fork() of the shell   */
+/* running RunRelay(), no tee is exec'd, and it is one  */
+/* more process of the job, in its process group. shut  */
+/* is the read end of the pipe to the next stage. The   */
+/* relay must not hold it, or it would never see EPIPE. */
+/* **************************************************** */
+static void ForkRelay(Relay *R, Process *Me, int shut)
+{
+    TRACE_BEGIN("relay", NULL);
+    Me->PID = fork();
+    switch (Me->PID) {
+        case -1:                                        /* The stage gets EPIPE                  */
+            perror("fork");
+            StageDone(processList, Me, EXIT_FAILURE);
+            break;
+        case 0:                                         /* Relay, never returns                  */
+            if (shut != SI) close(shut);
+            JoinJob(Me);                                /* Stopped and killed with its stage     */
+            sigprocmask(SIG_SETMASK, &childMask, NULL);
+            _exit(RunRelay(R));
+        default:
+            if (jobControl) setpgid(Me->PID, Me->job->pgid);
+            AddProcess(processList, Me, Me->PID);
+    }
+    CloseRelay(R);                                      /* The relay has its own copies          */
+    TRACE_END(Me->PID);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Marks the stages that were never launched as failed, */
+/* along with their relays from R on, and closes the    */
+/* pipe the first of them would read, and the $() fd    */
+/* the last stage would have written to.                */
+/* **************************************************** */
+static char AbortChain(Job *J, int N, int inPipe, Process *R)
+{
+    int out = J->stage[J->nPipes - 1].fd[1];
+
+    for (; N < J->nPipes; N++)                          /* Never launched, nothing left to reap  */
+        StageDone(processList, &J->stage[N], 1);        /* Report them as failed stages          */
+    for (; R < J->stage + J->nPipes + J->nRelays; R++)
+        StageDone(processList, R, 1);
+    J->printMe = 0;                                     /* Don't print the '+ completed message  */
+    if (inPipe != STDIN_FILENO) close(inPipe);          /* Earlier stages see EPIPE, not a hang  */
+    if (out != STDOUT_FILENO) close(out);               /* Nothing will write to the capture     */
+    return 1;                                           /* Bad command, return 1                 */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Launches every stage of the chain without waiting.   */
+/* Stages run concurrently, connected through pipes.    */
+/* Pipes and files are opened close-on-exec, so each    */
+/* stage only gets the two fds it is handed as STDIN    */
+/* and STDOUT. No stage holds a read end that keeps its */
+/* writer from seeing EPIPE, or a write end that keeps  */
+/* a reader from seeing EOF. The shell only has the     */
+/* pipe between two stages open, so the chain can be    */
+/* any length. A stage with several '>' files writes to */
+/* a relay instead, which passes the output on to the   */
+/* files and the next stage. The last stage writes to   */
+/* the fd AddJob() was given, STDOUT or the memfd a $() */
+/* captures into, unless it has a '>' file.             */
+/* **************************************************** */
+static char ForkChain(Command *C, Job *J)
+{
+    Process *cP;                                        /* Stage being launched                  */
+    Process *relay = J->stage + J->nPipes;              /* Next relay's slot, after the stages   */
+    Stage *S;
+    Relay R;                                            /* Sinks of a fanned out stage           */
+    int N;                                              /* Pipe iterator                         */
+    int link[2];                                        /* FD for chaining pipes together        */
+    int inPipe = STDIN_FILENO;                          /* Read end of the previous stage's pipe */
+    int next;                                           /* Write end of the pipe to the next one */
+    int out;                                            /* Output AddJob() gave the stage        */
+
+    for (N = 0; N < C->nStages; N++) {
+        cP = &J->stage[N];
+        S = &C->stage[N];
+        out = cP->fd[1];
+        if (Redirect(S, cP->fd)) {
+            cP->fd[1] = out;                            /* AbortChain() closes a capture         */
+            return AbortChain(J, N, inPipe, relay);
+        }
+        if ((N + 1 == C->nStages) && (out != SO)) {     /* Captured, unless a '>' file took it   */
+            if (cP->fd[1] == SO) cP->fd[1] = out;
+            else close(out);
+        }
+        if (N != 0) cP->fd[0] = inPipe;                 /* Piped input after the first stage     */
+        next = -1;
+        if (N + 1 < C->nStages) {                       /* Not the last stage, pipe to the next  */
+            if (pipe2(link, O_CLOEXEC) == -1) {         /* Create the Pipe                       */
+                perror("pipe");                         /* Out of fds, stop the chain here       */
+                if (cP->fd[1] != SO) close(cP->fd[1]);  /* First '>' file of a fanned out stage  */
+                return AbortChain(J, N, cP->fd[0], relay);
+            }
+            next = link[1];
+            inPipe = link[0];                           /* Next stage reads from it              */
+        }
+        if (S->nTee) {                                  /* Several sinks, the relay feeds them   */
+            if (OpenRelay(&R, S, cP->fd, next, J->arena)) {
+                if ((next != -1) && (cP->fd[0] != SI)) close(cP->fd[0]);
+                return AbortChain(J, N, (next != -1) ? inPipe : cP->fd[0], relay);
+            }
+        } else if (next != -1)
+            cP->fd[1] = next;                           /* Child will write to the pipe          */
+        if (S->nAssign)                                 /* "X=1 cmd", X=1 for this stage only    */
+            cP->envp = StageEnv(S->assign, S->nAssign, J->arena);
+        LaunchMe(S->argv, cP);                          /* Start the process & close its fds     */
+        if (S->nTee) ForkRelay(&R, relay++, (next != -1) ? inPipe : SI);
+    }
     return 0;
 }
 /* **************************************************** */
+/* **************************************************** */
+/* Execute program commands. Every stage of a piped     */
+/* command is forked up front, then the whole chain is  */
+/* waited on as a group. Stages launched before a file  */
+/* failed to open are still waited on.                  */
+/* Returns -1 if a stage couldn't be launched, else the */
+/* status Wait4Me() gives, 0 for a background chain     */
+/* **************************************************** */
+int ExecProgram(Command *C, Job *J)
+{
+    int status;
+    char failed = ForkChain(C, J);                      /* Launch all stages concurrently        */
+    if (J->isBG) return failed ? -1 : 0;                /* Background chains are reported later  */
+    TRACE_BEGIN("wait", NULL);
+    status = Wait4Me(J);                                /* Foreground chains block until done    */
+    TRACE_END(0);
+    return failed ? -1 : status;
+}
+/* **************************************************** */
 
 /* **************************************************** */
-/* Wrapper to execute anything sent from command line   */
+/* Sets where the bodies of '<<' here-documents are     */
+/* read from: the script in batch mode, a "> " prompt   */
+/* at the keyboard                                      */
 /* **************************************************** */
-char RunCommand(char *cmdLine)
+void SetHereSource(MoreFn more, void *ctx)
+{
+    hereMore = more;
+    hereCtx  = ctx;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Parses a command line into C, in A, and reads the   */
+/* bodies of its '<<'s from more(). A line with a '<<'  */
+/* is parsed from the arena's copy, reading the body    */
+/* may move the caller's buffer.                        */
+/* Returns 0 if good command, 1 if bad command          */
+/* **************************************************** */
+char ParseLine(char *cmdLine, Command *C, Arena *A, MoreFn more, void *ctx)
+{
+    char failed;
+
+    FlushOut();                                         /* Builtins and errors write directly    */
+    if (strstr(cmdLine, "<<") != NULL)                  /* Words must outlive the next lines     */
+        cmdLine = ArenaDup(A, cmdLine);
+    TRACE_BEGIN("parse", NULL);
+    failed = ParseCommand(cmdLine, C, A);
+    TRACE_END(0);
+    if (!failed && C->nHere)                            /* Bodies are on the lines that follow   */
+        failed = ReadHereDocs(C, A, more, ctx);
+    return failed;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs a parsed command line. Its $(...)s and $NAMEs   */
+/* are filled in first, every time, so a line parsed    */
+/* once can be run again. cmdCopy is the line as typed, */
+/* in A. A is released once the command is finished,    */
+/* or by the job that took it.                          */
+/* Returns 1 if 'exit' was run, 0 otherwise             */
+/* **************************************************** */
+char RunParsed(Command *C, Arena *A, char *cmdCopy)
 {
-    char ***Cmds = (char ***) malloc(MAX_TOKENS * sizeof(char**));
-    Process *P;                                         /* New Process Pointer                   */
-    char isBg = 0;                                      /* Flag for background commands          */
-    char *cmdCopy = (char *) malloc(strlen(cmdLine)+1); /* Holds copy of the command line        */
-    char numPipes = 0;                                  /* Num pipes in the command +1 (max 255  */
+    Job *J;                                             /* New Job Pointer                       */
     int fd[2] = {SI, SO};                               /* Holds I/O file descriptors            */
+    char timeMe = (getenv("SSHELL_TIMES") != NULL);     /* Usage suffix on every job             */
+    int status;
+    char quit, failed;
+
+    FlushOut();                                         /* Builtins and errors write directly    */
+    failed = C->nSubst && ExpandCommand(C, A);          /* Runs each $(...) into argv            */
+    if (failed || !C->nStages) {                        /* Bad command, or nothing on the line   */
+        FreeArena(A);
+        return 0;
+    }
+    if (!C->stage[0].argc) {                            /* Only NAME=value, sets shell variables */
+        CompleteCmd(cmdCopy, AssignVars(C->stage[0].assign, C->stage[0].nAssign));
+        FreeArena(A);
+        return 0;
+    }
+    if (!strcmp(C->stage[0].argv[0], "time")) {         /* 'time' reports what the rest used     */
+        timeMe = 1;
+        C->stage[0].argv++;                             /* Run the rest of the line as usual     */
+        if (!--C->stage[0].argc) {                      /* Nothing to time                       */
+            if (C->nStages > 1) InvalidCommand();
+            else CompleteCmd(cmdCopy, 0);
+            FreeArena(A);
+            return 0;
+        }
+    }
+    if (!strcmp(C->stage[0].argv[0], "exit")) {         /* 'exit' forces main loop to break      */
+        FreeArena(A);
+        return 1;
+    }
     
-    strcpy(cmdCopy, cmdLine);                           /* Make the copy                         */
-    cmdLine = InsertSpaces(cmdLine);                    /* Add spaces before and after <>&       */
-    cmdLine = RemoveWhitespace(cmdLine);                /* Remove leading/trailing whitespace    */
-    
-    if (CheckCommand(cmdLine, &isBg)) return 0;         /* Check for bad character placement     */
-    Cmds = Pipes2Arrays(cmdLine, &numPipes);            /* Breakup command into  *array[][]      */
-    
-    if (Cmds[0] == NULL)              return 0;         /* Return if nothing in command line     */
-    if (!strcmp(Cmds[0][0], "exit"))  return 1;         /* 'exit' forces main loop to break      */
+    if (!strcmp(C->stage[0].argv[0], "cd"))             /* If first command = "cd"               */
+        CompleteCmd(cmdCopy, ChangeDir(&C->stage[0].argv[1]));
     
-    if (!strcmp(Cmds[0][0], "cd"))                      /* If first command = "cd"               */
-        CompleteCmd(cmdCopy, ChangeDir(&Cmds[0][1]));   /* cd and print + completed message      */
+    else if (!strcmp(C->stage[0].argv[0], "pwd"))       /* If first command = "pwd"              */
+        CompleteCmd(cmdCopy, PrintWDir(&C->stage[0]));  /* pwd & print + completed message       */
     
-    else if (!strcmp(Cmds[0][0], "pwd"))                /* If first command = "pwd"              */
-        CompleteCmd(cmdCopy, PrintWDir(Cmds[0]));       /* pwd & print + completed message       */
+    else if (!strcmp(C->stage[0].argv[0], "hash"))      /* If first command = "hash"             */
+        CompleteCmd(cmdCopy, HashPaths(&C->stage[0]));  /* hash & print + completed message      */
+
+    else if (!strcmp(C->stage[0].argv[0], "export"))    /* If first command = "export"           */
+        CompleteCmd(cmdCopy, ExportEnv(&C->stage[0]));  /* export & print + completed message    */
+
+    else if (!strcmp(C->stage[0].argv[0], "unset"))     /* If first command = "unset"            */
+        CompleteCmd(cmdCopy, UnsetVars(C->stage[0].argv));
+
+    else if (!strcmp(C->stage[0].argv[0], "source")) {  /* Runs a script in this shell           */
+        status = SourceScript(C->stage[0].argv[1], &quit);
+        if (!quit) CompleteCmd(cmdCopy, status);        /* Its lines report themselves           */
+        FreeArena(A);
+        return quit;
+    }
+
+    else if (!strcmp(C->stage[0].argv[0], "parallel")   /* Runs a command per argument, N at once */
+             || !strcmp(C->stage[C->nStages - 1].argv[0], "parallel"))
+        RunParallel(C, cmdCopy);                        /* Prints its own + completed summary    */
+
+    else if (FindJobBuiltin(C->stage[0].argv[0]) != NULL)/* jobs, fg, bg, wait or kill            */
+        RunJobBuiltin(C, cmdCopy);
     
-    else {                                              /* Otherwise, try executing the pipes    */
-        P = AddProcess(processList, 0, cmdCopy, numPipes, isBg, fd);
-        if(ExecProgram((char ***)Cmds, P)) {            /* If this returns 1, something failed   */  
-            P->running = 0;                             /* Mark the process as done              */
-            P->status  = 1;                             /* Set the failure status                */
-            P->printMe = 0;                             /* Don't print the '+ completed message  */
-        } 
+    else if (timeMe || !RunBuiltin(C, cmdCopy)) {       /* Otherwise, try executing the pipes    */
+        J = AddJob(processList, A, cmdCopy, C->nStages, C->nFanOut, C->isBG, fd);
+        if (timeMe) TimeJob(processList, J);            /* Usage suffix on '+ completed'         */
+        ExecProgram(C, J);                              /* Failed stages are marked by ExecProgram */
+        return 0;                                       /* Arena is freed when the job is reaped */
     }
+    FreeArena(A);                                       /* Builtins are done with it already     */
     return 0;                                           /* Continue main loop                    */
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Sets up file redirects and checks against piped FDs  */
+/* Runs one command line. Everything parsed out of the  */
+/* line lives in one arena which is released once the   */
+/* command is finished.                                 */
 /* **************************************************** */
-char CheckRedirect(char **cmds[], Process *P, int N)
+static char RunLine(char *cmdLine)
 {
-    if (Redirect(cmds[N], P->fd)) return 1;             /* Bad command, return 1                 */
-    if ((P->fd[0] != SI) && (N != 0)){                  /* Can't have piped input & file input   */
-        BadInputRedirect();                             /* Error: mislocated input redirection   */
-        return 1;                                       /* Bad command, return 1                 */
-    }
-    if ((P->fd[1] != SO) && (cmds[N+1]!= NULL)){        /* Can't have piped output and file out  */
-        BadOutputRedirect();                            /* Error: mislocated output redirection  */
-        return 1;                                       /* Bad command, return 1                 */
+    Arena *A = NewArena();                              /* Holds all parse & launch data         */
+    Command C;                                          /* Stages parsed out of the line         */
+    char *cmdCopy = ArenaDup(A, cmdLine);               /* Holds copy of the command line        */
+
+    if (ParseLine(cmdLine, &C, A, hereMore, hereCtx)) { /* Bad command                           */
+        FreeArena(A);
+        return 0;
     }
-    return 0;                                           /* No bad connections, return 0          */
+    return RunParsed(&C, A, cmdCopy);
 }
 /* **************************************************** */
 /* **************************************************** */
-/* Sets up redirective file descriptors if present      */
-/* Returns file descriptors via fd pointer              */
-/* Returns 0 if good command, 1 if bad command          */
+/* Wrapper to execute anything sent from command line   */
+/* Traced as one "command" span holding the rest.       */
 /* **************************************************** */
-char Redirect(char *args[], int *fd)
-{                                    
-    char sym;                                           /* Holds redirect character               */
-    int i = 0;                                          /* Iterator                               */        
+char RunCommand(char *cmdLine)
+{
+    char quit;
+    TRACE_BEGIN("command", cmdLine);                    /* Before the parser cuts the line up    */
+    quit = RunLine(cmdLine);
+    TRACE_END(0);
+    return quit;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Opens the stage's redirect files, or the fd holding  */
+/* its here-document, if any.                           */
+/* Returns file descriptors via fd pointer. Placement   */
+/* was already checked by ParseCommand().               */
+/* Returns 0 if good command, 1 if a file won't open    */
+/* **************************************************** */
+char Redirect(Stage *S, int *fd)
+{
+    char failed = 0;
     fd[0] = STDIN_FILENO;                               /* Input file descriptor to return        */
     fd[1] = STDOUT_FILENO;                              /* Output file descriptor to return       */
-    while (args[i++] != NULL) {                         /* Iterate through the arguments          */
-        if ((sym = Check4Special(*args[i-1]))) {        /* Check if args are <> or &              */
-            if ((args[i] == NULL) || sym == '&') {      /* If no argument after <>, or ends in &  */
-                switch(sym){                            /* Output an error message                */
-                    case '<':
-                        NoInputFile();                  /* Error: no input file                   */        
-                        break;   
-                    case '>':                           
-                        NoOutputFile();                 /* Error: no output file                  */
-                        break;
-                    case '&':
-                        ThrowError("Error: mislocated background sign");
-                    default:
-                        ThrowError("Error: Oops!");
-                }        
-                return 1;                               /* Bad command, return 1                  */            
-            }                                           /* End - if no argument after <>          */
-
-            args[i-1] = NULL;                           /* Replace <> with NULL, terminates array */
-            if((sym == '>') && (fd[1] == SO)){          /* If output redirect, and out fd not set */
-                if((fd[1] = OpenMe(args[i], WMODE))==-1)/* Open for writing, if f=1 fopen failed  */
-                    return 1;                           /* Open failed                            */            
-            } else if ((sym == '<') && (fd[0] == SI)){  /* If input redirect, and in fd not set   */
-                if((fd[0] = OpenMe(args[i], RMODE))==-1)/* Set the input file descriptor          */
-                    return 1;                           /* Open Failed                            */
-            } else { 
-                ThrowError("Error: mislocated redirection");
-                return 1;                               /* Bad command, return 1                  */
-            }                                           /* End if '<' or if '>'                   */
-        }                                               /* End if args contain <>&                */  
-    }                                                   /* End while loop                         */
-    return 0;                                           /* Good command, return 0                 */
+    if ((S->inFile == NULL) && (S->inText == NULL) && (S->outFile == NULL))
+        return 0;                                       /* Nothing to open, nothing to trace      */
+
+    TRACE_BEGIN("redirect", NULL);
+    if (S->inFile != NULL)                              /* If input redirect                      */
+        if ((fd[0] = OpenMe(S->inFile, RMODE)) == -1)   /* Set the input file descriptor          */
+            failed = 1;                                 /* Open Failed                            */
+    if (S->inText != NULL)                              /* Here-document or '<<<' string          */
+        if ((fd[0] = OpenHere(S->inText, S->inLen)) == -1)
+            failed = 1;
+    if (!failed && (S->outFile != NULL))                /* If output redirect                     */
+        if ((fd[1] = OpenMe(S->outFile, WMODE)) == -1) {/* Open for writing                       */
+            if (fd[0] != SI) close(fd[0]);              /* Don't leak the input file              */
+            failed = 1;                                 /* Open failed                            */
+        }
+    TRACE_END(0);
+    return failed;                                      /* 0 if good, 1 if a file won't open       */
 }
 /* **************************************************** */
 
 /* **************************************************** */
-/*            Shell Initialization function             */
+/*       Process list & SIGCHLD signalfd initialization */
 /* **************************************************** */
-void InitShell(History *history, int *cursorPos)
+void InitProcesses(void)
 {
-    /* Initialize the global process list */
-    processList->count = 0;                             /* Number of outstanding processes = 0              */
-    processList->top = NULL;                            /* No outstanding processes yet                     */
-    
-    /* Initialize history structure */
-    history->count = 0;                                 /* Number of history items = 0                      */
-    history->traversed = 0;                             /* Traversed history items = 0                      */
-    history->top = NULL;                                /* No history entries yet                           */
-    history->current = NULL;                            /* Not currently viewing any entry                  */
-    
-    /* Setup SIGCHLD signal handler */
-    struct sigaction act;                               /* Sigaction struct for SIGCHLD signal handlers     */
-    act.sa_flags = SA_RESTART | SA_NOCLDSTOP;           /* Avoid EINTR | Only call when process terminates  */
-    act.sa_handler = ChildSignalHandler;                /* Define signal handler routine                    */
-    sigemptyset(&act.sa_mask);                          /* From noncanmode.c                                */
-
-    if (sigaction(SIGCHLD, &act, NULL)) {               /* Call sigaction, check for error                  */
-        perror("sigaction");                            /* If theres an error, throw it                     */
+    /* Initialize the global job table */
+    memset(processList, 0, sizeof(ProcessList));        /* No jobs, empty PID buckets, empty done queue     */
+
+    /* Route SIGCHLD to a file descriptor the main loop can poll */
+    sigemptyset(&routed);                               /* Build a mask holding only SIGCHLD                */
+    sigaddset(&routed, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &routed, &childMask);        /* Never delivered, children get the old mask back  */
+    childFd = signalfd(-1, &routed, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (childFd == -1) {                                /* Check for error                                  */
+        perror("signalfd");                             /* If theres an error, throw it                     */
         exit(1);                                        /* Terminate the program                            */
     }
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/*            Shell Initialization function             */
+/* **************************************************** */
+void InitShell(History *history, Editor *E)
+{
+    OpenHistory(history);                               /* Map the history file kept between sessions       */
     
+    InitProcesses();                                    /* Empty process list, SIGCHLD signalfd             */
+    interactive = 1;                                    /* Keys typed during a job are kept                 */
     SetNonCanMode();                                    /* Switch to non-canonical terminal mode            */
+    if (InitJobControl()) {                             /* Jobs get process groups and the terminal         */
+        sigaddset(&routed, SIGINT);                     /* Ctrl-C at the prompt comes in like SIGCHLD       */
+        sigprocmask(SIG_BLOCK, &routed, NULL);
+        signalfd(childFd, &routed, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
     SayHello();                                         /* Print the welcome message                        */
-    DisplayPrompt(cursorPos);                           /* Print the prompt and clear the cursor position   */
+    DisplayPrompt();                                    /* Print the prompt                                 */
+    InitEditor(E);                                      /* Empty line right after it                        */
 }
 /* **************************************************** */
 
 /* **************************************************** */
 /*                        MAIN                          */
+/*      Left out when linked into the bench driver      */
+/* **************************************************** */
+#ifndef SSHELL_BENCH
 /* **************************************************** */
+/* Reads a here-document line at a "> " prompt, into    */
+/* the editor ctx, with the main loop's line editing    */
+/* but no history. Ctrl-C, or Ctrl-D on an empty line,  */
+/* ends the input and returns NULL.                     */
+/* **************************************************** */
+static char *MoreLine(void *ctx, size_t *len)
+{
+    Editor *E = (Editor *) ctx;
+    const char *prompt = SHELL_PROMPT;
+    char key;
+
+    SHELL_PROMPT = HERE_PROMPT;                         /* Redraws and wrapping use "> " too             */
+    DisplayPrompt();
+    ResetEditor(E);
+    while ((key = NextKey(E)) != RETURN) {
+        if ((key == CTRL_C) || ((key == CTRL_D) && !LineLength(E)))
+            break;                                      /* No more lines                                 */
+        switch (key) {
+            case CTRL_D:                                /* Deletes under the cursor                      */
+                if (!DeleteForward(E)) ErrorBell();
+                break;
+
+            case BACKSPACE:
+            case CTRL_H:
+                if (!DeleteBack(E)) ErrorBell();
+                break;
+
+            case CTRL_U:                                /* Delete to the start of the line               */
+                KillTo(E, 0);
+                break;
+
+            case ESCAPE:                                /* Arrows, HOME, END, ... but not UP and DOWN    */
+                EscapeKey(NULL, E);
+                break;
+
+            default:
+                if (((unsigned char) key < ' ') || !InsertKey(E, key))
+                    ErrorBell();
+        }
+        RefreshLine(E);
+    }
+    LeaveLine(E);
+    if (key == CTRL_C) Emit(SO, "^C", 2);
+    PrintNL();
+    FlushOut();                                         /* Before the command writes below it            */
+    SHELL_PROMPT = prompt;
+    if (key != RETURN) return NULL;                     /* Input ended before the delimiter              */
+    *len = LineLength(E);
+    return LineText(E);
+}
+/* **************************************************** */
+
 int main(int argc, char *argv[], char *envp[])
 {
-    int cursorPos = 0;
-    char keystroke, cmdLine[MAX_BUFFER];
+    char keystroke;
+    Editor line;                                         /* Gap buffer, grows past its stack storage        */
+    Editor more;                                         /* Here-document lines, typed after the command    */
     unsigned char tryExit = 0, keepRunning = 1;
 
+    InitVars(envp);                                      /* Variables, and the envp programs get            */
     processList = malloc(sizeof(ProcessList));           /* Global list of processes being tracked, @TODO make it local */
+    InitTrace();                                         /* Spans go to $SSHELL_TRACE, if it is set         */
+    if (argc > 1) {                                      /* 'sshell script' runs the script in batch mode   */
+        InitProcesses();                                 /* No terminal setup, prompt or history needed     */
+        return RunBatch(argv[1]);
+    }
+
     History *history = (History*)malloc(sizeof(History));/* Local list of history entries                   */
-    InitShell(history, &cursorPos);                      /* Initialize the shell                            */
+    InitShell(history, &line);                           /* Initialize the shell                            */
+    InitEditor(&more);
+    SetHereSource(MoreLine, &more);                      /* '<<' bodies are typed at a "> " prompt          */
 
 mainLoop:                                                /* Shell main loop label                           */
     while (keepRunning) {                                /* Main Loop                                       */
-        keystroke = Get1Char();                          /* @TODO main should be brief, clean this up       */
+        keystroke = NextKey(&line);                      /* Reports finished jobs while it waits            */
+        if (keystroke == CTRL_R)                         /* Search, then handle the key that ended it       */
+            keystroke = ReverseSearch(history, &line);
 
         /* Process the keystroke */                      /* @TODO Put switch{} into keystrokeHandler()      */
         switch(keystroke) {
             case CTRL_D:                                 /*  CTRL + D   */
+                if (LineLength(&line)) {                 /* Deletes under the cursor, exits on empty lines  */
+                    if (!DeleteForward(&line)) ErrorBell();
+                    break;
+                }
                 PrintNL();
                 keepRunning = 0;
                 break;
            
+            case CTRL_C:                                 /* Drops the line for a new prompt                 */
+                LeaveLine(&line);
+                Emit(SO, "^C", 2);
+                PrintNL();
+                DisplayPrompt();
+                ResetEditor(&line);
+                break;
+
             case TAB:                                    /*   TAB KEY   */
-                ErrorBell();
+                CompleteLine(&line);
                 break;
             
             case BACKSPACE:                              /*  BACKSPACE  */
-                if (cursorPos) {
-                    PrintBackspace();
-                    cursorPos -= 1;
-                }
-                else
-                    ErrorBell();
+            case CTRL_H:
+                if (!DeleteBack(&line)) ErrorBell();
+                break;
+
+            case CTRL_A:                                 /* Start of the line, emacs style                  */
+                if (!MoveCursor(&line, 0)) ErrorBell();
+                break;
+
+            case CTRL_E:                                 /* End of the line                                 */
+                if (!MoveCursor(&line, LineLength(&line))) ErrorBell();
+                break;
+
+            case CTRL_B:                                 /* One to the left                                 */
+                if (!line.gapStart || !MoveCursor(&line, line.gapStart - 1)) ErrorBell();
+                break;
+
+            case CTRL_F:                                 /* One to the right                                */
+                if (!MoveCursor(&line, line.gapStart + 1)) ErrorBell();
+                break;
+
+            case CTRL_K:                                 /* Delete to the end of the line                   */
+                KillTo(&line, LineLength(&line));
+                break;
+
+            case CTRL_U:                                 /* Delete to the start of the line                 */
+                KillTo(&line, 0);
+                break;
+
+            case CTRL_W:                                 /* Delete the word before the cursor               */
+                if (!KillTo(&line, WordLeft(&line))) ErrorBell();
                 break;
             
-            case ESCAPE:                                 /* ARROW KEYS  */
-                if (Get1Char() == ARROW)
-                    switch(Get1Char()) {
-                        case UP:                         /*     UP      */
-                            DisplayNextEntry(history, cmdLine, &cursorPos);
-                            break;
-                        case DOWN:                       /*    DOWN     */
-                            DisplayPrevEntry(history, cmdLine, &cursorPos);
-                            break;
-                        case LEFT:                       /*    LEFT     */
-                            ErrorBell();
-                            break;
-                        case RIGHT:                      /*    RIGHT    */
-                            ErrorBell();
-                            break;
-                    }
+            case ESCAPE:                                 /* ARROW KEYS, HOME, END, ...      */
+                EscapeKey(history, &line);
                 break;
 
             case RETURN:                                 /*  ENTER KEY  */
-                cmdLine[cursorPos] = '\0';
+                LeaveLine(&line);                        /* Output starts below all of a wrapped line       */
                 PrintNL();
-                AddHistory(history, cmdLine, cursorPos);
-                if((tryExit = RunCommand(cmdLine)))
+                AddHistory(history, LineText(&line), LineLength(&line));
+                if((tryExit = RunCommand(LineText(&line))))
                     keepRunning = 0;                     /* Stop the main loop if 'exit' received           */
                 else {                                    
                     CheckCompletedProcesses(processList);
-                    DisplayPrompt(&cursorPos);
+                    DisplayPrompt();
 		}                
+                ResetEditor(&line);
 		        break;
         
             default:                                     /* ANY OTHER KEY */
-                if (cursorPos < MAX_BUFFER) {            /* Make sure there's room in the buffer            */
-                    write(STDOUT_FILENO, &keystroke, 1); /* Write the keystroke on STDOUT                   */
-                    cmdLine[cursorPos++] = keystroke;
-                } else
-                    ErrorBell();
+                if (((unsigned char) keystroke < ' ') || !InsertKey(&line, keystroke))
+                    ErrorBell();                         /* Other control keys, or the line is too long     */
         }                                                /* End switch statement                            */
+        RefreshLine(&line);                              /* Sends only what changed, at the next flush      */
     }                                                    /* End Main Loop                                   */
     
     /* **************************************************************************************************** */
@@ -466,13 +1140,17 @@ mainLoop:                                                /* Shell main loop labe
         }
         keepRunning = 1;                                 /* Set the while loop to continue running          */
         CheckCompletedProcesses(processList);            /* Check for completed processes                   */
-        DisplayPrompt(&cursorPos);                       /* Reprint the prompt                              */
+        DisplayPrompt();                                 /* Reprint the prompt                              */
+        ResetEditor(&line);
         goto mainLoop;                                   /* Re-enter main loop via assembly JMP             */
     }
 
+    CloseHistory(history);                               /* Everything typed is already in the file         */
     ResetCanMode();                                      /* Switch back to previous terminal mode           */
     SayGoodbye();                                        /* Print the exit message                          */
+    FlushOut();                                          /* Last flush, nothing else is printed             */
     
     return EXIT_SUCCESS;
 }
+#endif
     /* **************************************************************************************************** */
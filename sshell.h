@@ -1,30 +1,43 @@
 #ifndef _SSHELL_H
 #define _SSHELL_H
 
+#include "parse.h"                                      /* Parsed command lines                                 */
 #include "process.h"                                    /* Structures and methods for tracking processes        */
 /* **************************************************** */
 /*                     Convenience                      */
 /* **************************************************** */
 #define xStat(status) WEXITSTATUS(status)               /* Rename WEXITSTATUS                                   */
-#define WMODE (O_CREAT | O_TRUNC | O_WRONLY)            /* Create if doesn't exist, clear file, write only      */
-#define RMODE (O_RDONLY)				/* Read only mode 					*/
+#define WMODE (O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC) /* Create if doesn't exist, clear file, write only     */
+#define RMODE (O_RDONLY | O_CLOEXEC)			/* Read only mode, children only get it as STDIN	*/
 
 /* **************************************************** */
 /*                       SShell                         */
 /* **************************************************** */
-void InitShell (History *history, int *cursorPos);      /* Initialize the shell and relevant objects            */
+void InitShell (History *history, Editor *E);           /* Initialize the shell and relevant objects            */
+void InitProcesses(void);                               /* Empty the job table, route SIGCHLD to a signalfd     */
 char ChangeDir(char *args[]);                           /* Handles 'cd' commands                                */
-char PrintWDir(char *args[]);                           /* Handles 'pwd' commands                               */
+char PrintWDir(Stage *S);                               /* Handles 'pwd' commands                               */
+char HashPaths(Stage *S);                               /* Handles 'hash' commands                              */
+char ExportEnv(Stage *S);                               /* Handles 'export' commands                            */
 char RunCommand (char *cmdLine);                    	/* Wrapper to execute whatever is on the command line   */
-char ExecProgram(char **cmds[], Process *P);            /* Execute program commands, inner-looped when piped    */
-void ForkMe(char *cmds[], Process *Me);                 /* Forks a process. Child executes, parent waits.       */
+char ParseLine(char *cmdLine, Command *C, Arena *A, MoreFn more, void *ctx); /* Parse, then '<<' bodies */
+char RunParsed(Command *C, Arena *A, char *cmdCopy);    /* Fills in $(...) and $NAME, then runs a parsed line   */
+int ExecProgram(Command *C, Job *J);                    /* Forks every piped stage, then waits for the chain    */
+void ForkMe(char *cmds[], Process *Me);                 /* Forks a process. Child executes, parent returns.     */
 void RunMe(char *cmds[], Process *Me);                  /* Execute a single execvp call post fork()             */
-void Wait4Me(Process *Me);                              /* Executes blocking or non-blocking wait               */
+int SpawnMe(char *cmds[], Process *Me);                 /* Starts a process with posix_spawnp(), no fork()      */
+void LaunchMe(char *cmds[], Process *Me);               /* Spawns a process, falls back to ForkMe() if needed   */
+int Wait4Me(Job *J);                                    /* Blocks until a foreground chain ends or is stopped   */
+char WaitEvent(char keys);                              /* Sleeps until a child ends or a key is typed          */
+char WaitInput(int fd);                                 /* Sleeps until a child ends or fd has input            */
+char Interrupted(void);                                 /* 1 once for each Ctrl-C the shell got itself          */
+char NextKey(Editor *E);                                /* Next keystroke, reports finished jobs while waiting  */
+char ReverseSearch(History *history, Editor *E);        /* Ctrl-R search, returns the key ending it             */
+void EscapeKey(History *history, Editor *E);            /* Arrows, HOME, END, DELETE and word moves             */
 int OpenMe(const char *Me, const int Mode);		/* Calls fopen(), checks for errors 			*/
-char Redirect(char *args[], int *fd);                   /* Sets up input/output file descriptors                */
-char CheckRedirect(char **cmds[], Process *P, int N);   /* Sets up redirects and checks if piped                */
-char **Cmd2Array (char *cmd);                       	/* Breaks up  a command into an array of arguments      */
-char ***Pipes2Arrays (char *cmd, char *numPipes);       /* Breaks up command into arrays of piped arguments     */
+char Redirect(Stage *S, int *fd);                       /* Sets up input/output file descriptors                */
+int OpenHere(const char *text, size_t len);             /* Read fd holding a here-document, no file involved    */
+void SetHereSource(MoreFn more, void *ctx);             /* Where '<<' bodies are read from, line by line        */
 /* **************************************************** */
 
 #endif
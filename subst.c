@@ -0,0 +1,231 @@
+#define _GNU_SOURCE                                     /* memfd_create()                           */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "common.h"                                     /* Check4Space(), errors and fd names       */
+#include "history.h"                                    /* History structures, needed by sshell.h   */
+#include "sshell.h"                                     /* ExecProgram() and the job table          */
+#include "builtin.h"                                    /* CaptureBuiltin()                         */
+#include "jobs.h"                                       /* JOB_STOPPED                              */
+#include "subst.h"                                      /* Substitution prototypes                  */
+#include "env.h"                                        /* GetVar() for $NAME                       */
+#include "trace.h"                                      /* "subst" spans                            */
+
+/* **************************************************** */
+/* Runs the n bytes of cmd as a command line of its own */
+/* and returns what it printed, NUL terminated, in A,   */
+/* without its trailing newlines.                       */
+/* STDOUT of its last stage is a memfd_create() file,   */
+/* which grows in memory as the command writes, so the  */
+/* command can't block on a full pipe while the shell   */
+/* waits for it, and nothing touches the file system.   */
+/* It is a foreground job like any other, CTRL+C and    */
+/* CTRL+Z work on it, but it isn't reported. A builtin  */
+/* utility writes to the memfd from the shell without a */
+/* fork().                                              */
+/* Returns NULL if it couldn't be parsed or run, or was */
+/* stopped by CTRL+C or CTRL+Z                          */
+/* **************************************************** */
+char *Substitute(const char *cmd, size_t n, Arena *A, size_t *len)
+{
+    Arena *B = NewArena();                              /* Owned by the job once it is launched     */
+    char *line = (char *) memcpy(ArenaAlloc(B, n + 1), cmd, n);
+    char *text, *cmdCopy;
+    Command C;
+    Job *J;
+    int fd[2], mem, status = 0;
+    off_t size;
+    ssize_t got;
+
+    line[n] = '\0';
+    TRACE_BEGIN("subst", line);
+    if ((mem = memfd_create("subst", MFD_CLOEXEC)) == -1) {
+        perror("memfd_create");
+        FreeArena(B);
+        TRACE_END(0);
+        return NULL;
+    }
+    cmdCopy = ArenaDup(B, line);                        /* For the job, parsing cuts line up        */
+    if (ParseCommand(line, &C, B) || (C.nHere && ReadHereDocs(&C, B, NULL, NULL))
+        || (C.nSubst && ExpandCommand(&C, B))) {        /* Errors are already reported              */
+        FreeArena(B);
+        close(mem);
+        TRACE_END(0);
+        return NULL;
+    }
+
+    if (!C.nStages || !C.stage[0].argc || (CaptureBuiltin(&C, mem) != BUILTIN_EXTERNAL))
+        FreeArena(B);                                   /* Nothing to run, or ran without a fork()  */
+    else if ((fd[1] = fcntl(mem, F_DUPFD_CLOEXEC, 0)) == -1) {
+        perror("fcntl");                                /* Out of fds                               */
+        FreeArena(B);
+    } else {
+        fd[0] = SI;                                     /* fd[1] is closed by the job's last stage  */
+        J = AddJob(processList, B, cmdCopy, C.nStages, C.nFanOut, FALSE, fd);
+        J->printMe = 0;                                 /* The line it is part of is reported       */
+        status = ExecProgram(&C, J);                    /* Waits for it, B goes with the job        */
+    }
+    if ((status == 128 + SIGINT) || (status == JOB_STOPPED)) {
+        close(mem);                                     /* Ctrl-C or Ctrl-Z drops the whole line    */
+        TRACE_END(0);
+        return NULL;
+    }
+
+    size = lseek(mem, 0, SEEK_END);
+    text = (char *) ArenaAlloc(A, (size > 0 ? size : 0) + 1);
+    for (*len = 0; (size > 0) && (*len < (size_t) size); *len += got)
+        if ((got = pread(mem, text + *len, size - *len, *len)) <= 0) break;
+    while (*len && (text[*len - 1] == '\n')) (*len)--; /* "a$(echo b)c" is "abc", as in sh        */
+    text[*len] = '\0';
+    close(mem);
+    TRACE_END(0);
+    return text;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Appends n bytes of s to the buffer Expand() builds,  */
+/* doubling it when it is full                          */
+/* **************************************************** */
+static char *Append(Arena *A, char *buf, size_t *len, size_t *room, const char *s, size_t n)
+{
+    size_t grown;
+    if (*len + n > *room) {                             /* Out of room, double it                   */
+        for (grown = 2 * *room; *len + n > grown; grown *= 2);
+        buf = (char *) ArenaGrow(A, buf, *room, grown);
+        *room = grown;
+    }
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return buf;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Returns word with each "$(...)" replaced by what it  */
+/* printed, and each $NAME or ${NAME} by its value, in  */
+/* A. A variable that isn't set is empty, and a '$' not */
+/* followed by a name is kept. Only what was filled in  */
+/* can hold spaces, the rest of the word has none, so   */
+/* splitting the result on whitespace splits exactly    */
+/* that. NULL if a command couldn't be run.             */
+/* **************************************************** */
+static char *Expand(char *word, Arena *A)
+{
+    size_t len = 0, room = strlen(word) + 1, n;
+    char *buf = (char *) ArenaAlloc(A, room);
+    char *p = word, *from, *end, *text;
+    const char *value;
+    int brace;
+
+    while ((from = strchr(p, '$')) != NULL) {
+        buf = Append(A, buf, &len, &room, p, from - p); /* Literal part before it                   */
+        if (from[1] == '(') {
+            end = MatchParen(from + 2);                 /* ParseCommand() checked it is there       */
+            if ((text = Substitute(from + 2, end - from - 2, A, &n)) == NULL) return NULL;
+            buf = Append(A, buf, &len, &room, text, n);
+            p = end + 1;
+            continue;
+        }
+        brace = (from[1] == '{');
+        n = VarName(from + 1 + brace);
+        if (!n || (brace && (from[2 + n] != '}'))) {    /* Not a variable, a plain '$'              */
+            buf = Append(A, buf, &len, &room, from, 1);
+            p = from + 1;
+            continue;
+        }
+        if ((value = GetVar(from + 1 + brace, n)) != NULL)
+            buf = Append(A, buf, &len, &room, value, strlen(value));
+        p = from + 1 + n + 2 * brace;                   /* Past the name, and its '}'               */
+    }
+    return Append(A, buf, &len, &room, p, strlen(p) + 1); /* The rest, and its NUL                */
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Splits s on whitespace, in place, and appends each   */
+/* word to the stage's argv. Returns the number added.  */
+/* **************************************************** */
+static int Split(Stage *S, char *s, Arena *A)
+{
+    int added = 0;
+    while (1) {
+        while (Check4Space(*s)) s++;
+        if (*s == '\0') return added;
+        AddArg(S, s, A);
+        added++;
+        while ((*s != '\0') && !Check4Space(*s)) s++;
+        if (*s != '\0') *s++ = '\0';                    /* Terminate the word in place              */
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Expands a '<' or '>' file name, which must come out  */
+/* as exactly one word. Returns 0 if good, 1 if not.    */
+/* **************************************************** */
+static char ExpandFile(char **file, Arena *A)
+{
+    Stage one;
+    char *text;
+
+    if ((*file == NULL) || (strchr(*file, '$') == NULL)) return 0;
+    if ((text = Expand(*file, A)) == NULL) return 1;
+    one.argSlots = TOKEN_CHUNK;                         /* Scratch stage to split into              */
+    one.argv = (char **) ArenaAlloc(A, one.argSlots * sizeof(char *));
+    one.argc = 0;
+    if (Split(&one, text, A) != 1) {
+        ThrowError("Error: ambiguous redirect");
+        return 1;
+    }
+    *file = one.argv[0];
+    return 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Runs every "$(...)" ParseCommand() found, in order,  */
+/* and fills in the variables, before anything of the   */
+/* line is started. Each word holding one is replaced   */
+/* by the words it splits into, none if it came out as  */
+/* only whitespace. A NAME=value word is filled in but  */
+/* never split. A line left with no words at all runs   */
+/* nothing.                                             */
+/* Returns 0 if good, 1 if a command couldn't be run    */
+/* **************************************************** */
+char ExpandCommand(Command *C, Arena *A)
+{
+    Stage *S;
+    char **argv, *text;
+    int N, i, argc;
+
+    for (N = 0; N < C->nStages; N++) {
+        S = &C->stage[N];
+        if (ExpandFile(&S->inFile, A) || ExpandFile(&S->outFile, A)) return 1;
+        for (i = 0; i < S->nTee; i++)
+            if (ExpandFile(&S->teeFile[i], A)) return 1;
+        for (i = 0; i < S->nAssign; i++)                /* One word whatever the value holds        */
+            if (strchr(S->assign[i], '$') != NULL)
+                if ((S->assign[i] = Expand(S->assign[i], A)) == NULL) return 1;
+
+        argv = S->argv;                                 /* Rebuilt from scratch                     */
+        argc = S->argc;
+        S->argSlots = TOKEN_CHUNK;
+        S->argv = (char **) ArenaAlloc(A, S->argSlots * sizeof(char *));
+        S->argc = 0;
+        for (i = 0; i < argc; i++)
+            if (strchr(argv[i], '$') == NULL) AddArg(S, argv[i], A);
+            else if ((text = Expand(argv[i], A)) == NULL) return 1;
+            else Split(S, text, A);
+        S->argv[S->argc] = NULL;
+
+        if (S->argc || ((C->nStages == 1) && S->nAssign)) continue; /* A program, or only NAME=value */
+        if (C->nStages == 1) C->nStages = 0;            /* "$(true)" alone, a blank line            */
+        else {
+            InvalidCommand();                           /* A stage of a pipeline ran out of words   */
+            return 1;
+        }
+    }
+    return 0;
+}
+/* **************************************************** */
@@ -0,0 +1,13 @@
+#ifndef _SUBST_H
+#define _SUBST_H
+
+#include "parse.h"                                      /* Substitutions are expanded in parsed stages      */
+
+/* **************************************************** */
+/*                 Substitution Functions               */
+/* **************************************************** */
+char ExpandCommand(Command *C, Arena *A);               /* Runs every $(...), fills in $NAMEs, splits argv  */
+char *Substitute(const char *cmd, size_t n, Arena *A, size_t *len); /* What cmd prints, NULL if it can't run */
+/* **************************************************** */
+
+#endif
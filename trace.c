@@ -0,0 +1,184 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"                                      /* Trace structures and prototypes          */
+
+/* **************************************************** */
+char tracing;                                           /* Set by InitTrace()                       */
+static int traceFd = -1;                                /* Trace file                               */
+static pid_t tracer;                                    /* Shell writing it, not a forked child     */
+static char events[TRACE_BUFFER];                       /* Events not yet written                   */
+static size_t queued;                                   /* Bytes used in events                     */
+static const char *comma = "";                          /* Separator before the next event          */
+/* **************************************************** */
+/* **************************************************** */
+/* Monotonic clock in microseconds, the unit of the     */
+/* trace-event format. Same clock as Process.start.     */
+/* **************************************************** */
+static double Micros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Writes the queued events                             */
+/* **************************************************** */
+static void Flush(void)
+{
+    size_t off = 0;
+    ssize_t put;
+
+    while (off < queued) {
+        if ((put = write(traceFd, events + off, queued - off)) <= 0) break;
+        off += put;
+    }
+    queued = 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Queues n bytes, writing the buffer out each time it  */
+/* fills, so a long command line needs no copy of its   */
+/* own                                                  */
+/* **************************************************** */
+static void Put(const char *s, size_t n)
+{
+    size_t part;
+    while (n) {
+        part = (n < TRACE_BUFFER - queued) ? n : TRACE_BUFFER - queued;
+        memcpy(events + queued, s, part);
+        queued += part;
+        s += part;
+        n -= part;
+        if (queued == TRACE_BUFFER) Flush();
+    }
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Queues a NUL terminated string as it is              */
+/* **************************************************** */
+static void PutStr(const char *s)
+{
+    Put(s, strlen(s));
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Queues s as the inside of a JSON string. Quotes,     */
+/* backslashes and control bytes are escaped, the rest  */
+/* is copied in runs.                                   */
+/* **************************************************** */
+static void PutText(const char *s)
+{
+    const char *run = s;
+    char esc[8];
+
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if ((c >= ' ') && (c != '"') && (c != '\\')) continue;
+        Put(run, s - run);
+        Put(esc, (c >= ' ') ? sprintf(esc, "\\%c", c) : sprintf(esc, "\\u%04x", c));
+        run = s + 1;
+    }
+    Put(run, s - run);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Queues the fields every event starts with            */
+/* **************************************************** */
+static void Head(const char *phase, pid_t tid, double ts)
+{
+    char head[TRACE_HEAD];
+    Put(head, snprintf(head, sizeof(head), "%s{\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+                       comma, phase, (int) tracer, (int) tid, ts));
+    comma = ",\n";
+}
+/* **************************************************** */
+
+/* **************************************************** */
+/* Opens the file $SSHELL_TRACE names and starts a      */
+/* Chrome trace-event JSON array in it. Nothing is      */
+/* traced if it isn't set. The array is closed at exit. */
+/* **************************************************** */
+void InitTrace(void)
+{
+    const char *path = getenv("SSHELL_TRACE");
+
+    if ((path == NULL) || !*path) return;
+    if ((traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+        perror("SSHELL_TRACE");
+        return;
+    }
+    tracer  = getpid();
+    tracing = 1;
+    PutStr("[\n");
+    Head("M", tracer, 0);                               /* Names the shell's track                  */
+    PutStr(",\"name\":\"process_name\",\"args\":{\"name\":\"sshell\"}}");
+    atexit(CloseTrace);
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Closes the JSON array and the file. A child forked   */
+/* by the shell that exits leaves both alone.           */
+/* **************************************************** */
+void CloseTrace(void)
+{
+    if (!tracing || (getpid() != tracer)) return;
+    PutStr("\n]\n");
+    Flush();
+    close(traceFd);
+    tracing = 0;
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Opens a span on the shell's track, e.g. "parse".     */
+/* text, the command line for instance, goes in its     */
+/* args. Spans nest, TraceEnd() closes the newest one.  */
+/* **************************************************** */
+void TraceBegin(const char *name, const char *text)
+{
+    Head("B", tracer, Micros());
+    PutStr(",\"name\":\"");
+    PutText(name);
+    if (text != NULL) {
+        PutStr("\",\"args\":{\"text\":\"");
+        PutText(text);
+        PutStr("\"}}");
+    } else
+        PutStr("\"}");
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Closes the newest open span. pid, the process the    */
+/* span started, goes in its args when it isn't 0.      */
+/* **************************************************** */
+void TraceEnd(long pid)
+{
+    char args[48];
+    Head("E", tracer, Micros());
+    if (pid) Put(args, sprintf(args, ",\"args\":{\"pid\":%ld}}", pid));
+    else PutStr("}");
+}
+/* **************************************************** */
+/* **************************************************** */
+/* Records a reaped stage from launch to exit, on a     */
+/* track named by its PID, with its job's command, its  */
+/* place in the pipeline and its exit status.           */
+/* **************************************************** */
+void TraceStage(Process *Me)
+{
+    char args[96];
+    char dur[32];
+
+    Head("X", Me->PID, Me->start * 1e6);
+    Put(dur, sprintf(dur, ",\"dur\":%.3f", Me->use.wall * 1e6));
+    PutStr(",\"name\":\"");
+    PutText(Me->job->cmd);
+    Put(args, sprintf(args, "\",\"args\":{\"stage\":%d,\"pid\":%d,\"status\":%d}}",
+                      (int) (Me - Me->job->stage), (int) Me->PID, Me->status));
+}
+/* **************************************************** */
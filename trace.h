@@ -0,0 +1,35 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "process.h"                                    /* Stages are traced when they are reaped           */
+
+/* **************************************************** */
+/*                   Trace Structures                   */
+/* **************************************************** */
+#define TRACE_BUFFER 65536                              /* Event bytes held back before one write()         */
+#define TRACE_HEAD   160                                /* Longest fixed part of one event                  */
+/* **************************************************** */
+
+/* **************************************************** */
+/*                  Global Structures                   */
+/* **************************************************** */
+extern char tracing;                                    /* 1 when $SSHELL_TRACE names a trace file          */
+/* **************************************************** */
+
+/* **************************************************** */
+/*                     Convenience                      */
+/* **************************************************** */
+#define TRACE_BEGIN(name, text) do { if (tracing) TraceBegin(name, text); } while (0) /* Only a test when off */
+#define TRACE_END(pid)          do { if (tracing) TraceEnd(pid); } while (0)
+
+/* **************************************************** */
+/*                    Trace Functions                   */
+/* **************************************************** */
+void InitTrace(void);                                   /* Opens $SSHELL_TRACE, if it is set                */
+void CloseTrace(void);                                  /* Ends the JSON array, runs at exit                */
+void TraceBegin(const char *name, const char *text);    /* Opens a span of the shell, text may be NULL      */
+void TraceEnd(long pid);                                /* Closes the newest open span, pid if it started 1 */
+void TraceStage(Process *Me);                           /* A reaped stage's lifetime, on a track of its own */
+/* **************************************************** */
+
+#endif